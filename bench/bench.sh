@@ -0,0 +1,54 @@
+#!/bin/sh
+# Builds p1, p2, p4, p5 & p6, generates a dictionary & query file at each size
+# and runs each engine against the same files, one JSON object per run.
+#
+# Usage: bench/bench.sh [sizes...]   e.g. bench/bench.sh 10000 1000000
+# QUERIES sets the number of lookups per run, SKEW their Zipf skew (0 for
+# uniform), SPLLFLAGS extra spll options (e.g. "-batch -hash wyhash"), OUT
+# the results file, WORK the scratch dir. SPLLFLAGS="-perf" adds hardware
+# event counts per key for the build & search, null where perf_event_open
+# is unavailable. p1 is also run with batched lookups over an incremental
+# resize, -batch -incremental.
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+WORK=${WORK:-/tmp/spll-bench}
+OUT=${OUT:-bench-results.jsonl}
+QUERIES=${QUERIES:-1000000}
+SKEW=${SKEW:-0}
+CFLAGS="-O2 -Wall -Wextra -Wfloat-equal -pedantic -ansi"
+SIZES=${*:-"10000 100000 1000000 10000000"}
+
+mkdir -p "$WORK" || exit 1
+gcc $CFLAGS "$ROOT/bench/gendict.c" -o "$WORK/gendict" -lm || exit 1
+for engine in p1 p2; do
+    gcc $CFLAGS "$ROOT/$engine"/*.c -o "$WORK/$engine" -lm -pthread || exit 1
+done
+# The later engines keep only their tables, the rest is shared from common
+for engine in p4 p5 p6; do
+    gcc $CFLAGS -I"$ROOT/common" -I"$ROOT/$engine" "$ROOT/$engine"/*.c \
+        "$ROOT"/common/*.c -o "$WORK/$engine" -lm -pthread || exit 1
+done
+
+# Runs an engine on the current files with any extra options, appending
+# its JSON to the results
+run_engine() {
+    engine=$1
+    shift
+    run="$WORK/$engine.json"
+    "$WORK/$engine" "$dict" "$queries" -bench $SPLLFLAGS "$@" > "$run" ||
+        exit 1
+    tee -a "$OUT" < "$run"
+}
+
+for size in $SIZES; do
+    dict="$WORK/dict-$size.txt"
+    queries="$WORK/queries-$size-$QUERIES-$SKEW.txt"
+    [ -f "$dict" ] || "$WORK/gendict" "$size" > "$dict" || exit 1
+    [ -f "$queries" ] ||
+        "$WORK/gendict" "$size" "$QUERIES" 1 "$SKEW" > "$queries" || exit 1
+
+    for engine in p1 p2 p4 p5 p6; do
+        run_engine $engine
+    done
+    run_engine p1 -batch -incremental
+done
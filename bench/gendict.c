@@ -0,0 +1,147 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+
+#define MINWORDS 1
+#define MAXWORDS 100000000L
+#define MAXWORDLEN 15
+#define LETTERS 26
+#define DEFAULTSEED UINT64_C(1)
+#define UNITSCALE (1.0 / 9007199254740992.0)
+
+#define ERR_USAGE     "Usage: gendict count [queries] [seed] [skew]\n"
+#define ERR_BAD_COUNT "ERROR - count must be between 1 and 100000000.\n"
+
+enum Exit_Codes {
+    bad_usage = 5,
+    bad_count = 6
+};
+
+long GCD(long a, long b);
+long NextRandom(uint64_t *state, long range);
+double NextUniform(uint64_t *state);
+long ZipfRank(uint64_t *state, long count, double skew);
+void PrintWord(long index, long count, long multiplier);
+
+/* Writes count distinct lower case words, one per line, for spll to load as
+ * a dictionary. Given queries, instead writes that many words picked at
+ * random from the same dictionary, so every query is found. A skew above 0
+ * picks them Zipf distributed instead of uniformly, like a real query log */
+int main(int argc, char **argv)
+{
+    long count, queries, multiplier, i;
+    uint64_t state = DEFAULTSEED;
+    double skew = 0;
+
+    if (argc < 2 || argc > 5) {
+        fprintf(stderr, ERR_USAGE);
+        exit(bad_usage);
+    }
+    count = atol(argv[1]);
+    if (count < MINWORDS || count > MAXWORDS) {
+        fprintf(stderr, ERR_BAD_COUNT);
+        exit(bad_count);
+    }
+    if (argc >= 4) {
+        state = (uint64_t)strtoul(argv[3], NULL, 0);
+    }
+    if (argc == 5) {
+        skew = atof(argv[4]);
+    }
+
+    /* Walk the words in a scrambled order, any multiplier coprime to count
+     * visits each index exactly once */
+    multiplier = count / 2 + NextRandom(&state, count / 2 + 1);
+    while (GCD(multiplier, count) != 1) {
+        multiplier++;
+    }
+
+    if (argc >= 3) {
+        queries = atol(argv[2]);
+        for (i = 0; i < queries; i++) {
+            if (skew > 0) {
+                PrintWord(ZipfRank(&state, count, skew), count, multiplier);
+            }
+            else {
+                PrintWord(NextRandom(&state, count), count, multiplier);
+            }
+        }
+    }
+    else {
+        for (i = 0; i < count; i++) {
+            PrintWord(i, count, multiplier);
+        }
+    }
+
+    return 0;
+}
+
+long GCD(long a, long b)
+{
+    long t;
+
+    while (b != 0) {
+        t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/* 64 bit LCG, returning a value from 0 to range - 1 */
+long NextRandom(uint64_t *state, long range)
+{
+    *state = *state * UINT64_C(6364136223846793005) +
+             UINT64_C(1442695040888963407);
+    return (long)((*state >> 33) % (uint64_t)range);
+}
+
+/* Uniform double in [0, 1) from the top 53 bits of the LCG */
+double NextUniform(uint64_t *state)
+{
+    *state = *state * UINT64_C(6364136223846793005) +
+             UINT64_C(1442695040888963407);
+    return (double)(*state >> 11) * UNITSCALE;
+}
+
+/* Zipf distributed index from 0 to count - 1, index 0 the most common. Uses
+ * the inverse of the continuous x^-skew distribution over [1, count + 1) */
+long ZipfRank(uint64_t *state, long count, double skew)
+{
+    double u = NextUniform(state), x;
+    long rank;
+
+    if (fabs(skew - 1) < 1e-9) {
+        x = pow(count + 1.0, u);
+    }
+    else {
+        x = pow((pow(count + 1.0, 1 - skew) - 1) * u + 1, 1 / (1 - skew));
+    }
+
+    rank = (long)x - 1;
+    if (rank < 0) {
+        rank = 0;
+    }
+    if (rank >= count) {
+        rank = count - 1;
+    }
+    return rank;
+}
+
+/* Prints the index'th word, the scrambled index written in bijective
+ * base 26 so every index gives a different word of letters only */
+void PrintWord(long index, long count, long multiplier)
+{
+    char word[MAXWORDLEN];
+    uint64_t n = (uint64_t)index * multiplier % count + 1;
+    int len = 0;
+
+    while (n > 0) {
+        n--;
+        word[len++] = (char)('a' + n % LETTERS);
+        n /= LETTERS;
+    }
+    word[len] = '\0';
+    puts(word);
+}
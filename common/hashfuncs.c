@@ -0,0 +1,262 @@
+#include "engine.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* wyhash constants */
+#define WYP0 UINT64_C(0xa0761d6478bd642f)
+#define WYP1 UINT64_C(0xe7037ed1a0b428db)
+/* xxh3 default secret words & avalanche prime */
+#define XXS0 UINT64_C(0xbe4ba423396cfeb8)
+#define XXS1 UINT64_C(0x1cad21f72c81017c)
+#define XXS2 UINT64_C(0xdb979083e96dd4de)
+#define XXS3 UINT64_C(0x1f67b3b7a4a44072)
+#define XXPRIME UINT64_C(0x165667919E3779F9)
+/* mix32 lane constants */
+#define MXLEN 0x9E3779B1u
+#define MXMUL 0x85EBCA77u
+#define MXFMIX1 0x85EBCA6Bu
+#define MXFMIX2 0xC2B2AE35u
+#define MXHIGHSEED 0x27D4EB2Fu
+
+/* Every selectable hash function, the first is the default */
+const HashFamily HashFamilies[] = {
+    {"classic", HashClassic, HashBatchScalar},
+    {"wyhash", HashWy, HashBatchScalar},
+    {"xxh3", HashXxh3, HashBatchScalar},
+    {"mix32", HashMix32, HashBatchMix32},
+    {NULL, NULL, NULL}
+};
+
+/* Returns the named hash family, or NULL if there is none */
+const HashFamily *FindHashFamily(char *name)
+{
+    int i;
+
+    for (i = 0; HashFamilies[i].name != NULL; i++) {
+        if (strcmp(HashFamilies[i].name, name) == 0) {
+            return &HashFamilies[i];
+        }
+    }
+    return NULL;
+}
+
+/* Copies the word into a zeroed KEYWIDTH byte block, returning its length.
+ * Words are shorter than MAXWORDLEN, so always fit with room to spare */
+unsigned int PadWord(char *str, unsigned char *block)
+{
+    size_t len = strlen(str);
+
+    if (len > KEYWIDTH) {
+        len = KEYWIDTH;
+    }
+    memset(block, 0, KEYWIDTH);
+    memcpy(block, str, len);
+    return (unsigned int)len;
+}
+
+/* Full 64 x 64 -> 128 bit multiply, as low & high halves */
+void Mul128(uint64_t a, uint64_t b, uint64_t *low, uint64_t *high)
+{
+#ifdef __SIZEOF_INT128__
+    __extension__ typedef unsigned __int128 uint128;
+    uint128 product = (uint128)a * b;
+
+    *low = (uint64_t)product;
+    *high = (uint64_t)(product >> 64);
+#else
+    uint64_t a_lo = a & 0xFFFFFFFFu, a_hi = a >> 32;
+    uint64_t b_lo = b & 0xFFFFFFFFu, b_hi = b >> 32;
+    uint64_t lo_lo = a_lo * b_lo, hi_lo = a_hi * b_lo;
+    uint64_t lo_hi = a_lo * b_hi, hi_hi = a_hi * b_hi;
+    uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFFu) + lo_hi;
+
+    *low = (cross << 32) | (lo_lo & 0xFFFFFFFFu);
+    *high = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+#endif
+}
+
+/* Multiplies to 128 bits and folds the halves together */
+uint64_t MulFold64(uint64_t a, uint64_t b)
+{
+    uint64_t low, high;
+
+    Mul128(a, b, &low, &high);
+    return low ^ high;
+}
+
+/* Little endian load of 8 bytes */
+uint64_t Read64(unsigned char *bytes)
+{
+    uint64_t value;
+
+    memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+/* wyhash's short key path, on the word padded to KEYWIDTH bytes */
+uint64_t HashWy(char *str, uint64_t seed)
+{
+    unsigned char block[KEYWIDTH];
+    uint64_t len = PadWord(str, block);
+    uint64_t a = Read64(block) ^ WYP1;
+    uint64_t b = Read64(block + 8);
+
+    seed ^= MulFold64(seed ^ WYP0, WYP1);
+    Mul128(a, b ^ seed, &a, &b);
+
+    return MulFold64(a ^ WYP0 ^ len, b ^ WYP1);
+}
+
+/* xxh3's 9-16 byte path, on the word padded to KEYWIDTH bytes */
+uint64_t HashXxh3(char *str, uint64_t seed)
+{
+    unsigned char block[KEYWIDTH];
+    uint64_t len = PadWord(str, block);
+    uint64_t input_lo = Read64(block) ^ ((XXS0 ^ XXS1) + seed);
+    uint64_t input_hi = Read64(block + 8) ^ ((XXS2 ^ XXS3) - seed);
+    uint64_t acc, swapped = 0;
+    int i;
+
+    /* Byte swap input_lo, the compiler turns this into one instruction */
+    for (i = 0; i < 8; i++) {
+        swapped = (swapped << 8) | ((input_lo >> (i * 8)) & 0xFF);
+    }
+    acc = len + swapped + input_hi + MulFold64(input_lo, input_hi);
+
+    /* xxh3 avalanche */
+    acc ^= acc >> 37;
+    acc *= XXPRIME;
+    acc ^= acc >> 32;
+    return acc;
+}
+
+/* One 32 bit mix32 lane over a padded word's four 32 bit words */
+unsigned int Mix32Lane(unsigned int *words, unsigned int len,
+                       unsigned int seed)
+{
+    unsigned int hash = seed ^ (len * MXLEN);
+    int i;
+
+    for (i = 0; i < KEYWIDTH / 4; i++) {
+        hash ^= words[i];
+        hash *= MXMUL;
+        hash ^= hash >> 15;
+    }
+
+    /* murmur3 finaliser */
+    hash ^= hash >> 16;
+    hash *= MXFMIX1;
+    hash ^= hash >> 13;
+    hash *= MXFMIX2;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+/* Two independent mix32 lanes, one per half of the 64 bit hash. Only uses
+ * 32 bit lane operations, so HashBatchMix32 can run 4 words side by side */
+uint64_t HashMix32(char *str, uint64_t seed)
+{
+    unsigned int words[KEYWIDTH / 4];
+    unsigned int len = PadWord(str, (unsigned char *)words);
+    unsigned int low = Mix32Lane(words, len, (unsigned int)seed);
+    unsigned int high = Mix32Lane(words, len,\
+                                  (unsigned int)(seed >> 32) ^ MXHIGHSEED);
+
+    return ((uint64_t)high << 32) | low;
+}
+
+/* Hashes the words one after another, for families with no vector path */
+void HashBatchScalar(const HashFamily *family, char **words, int num_words,
+                     uint64_t seed, uint64_t *hashes)
+{
+    int i;
+
+    for (i = 0; i < num_words; i++) {
+        hashes[i] = family->hash(words[i], seed);
+    }
+}
+
+#ifdef __SSE2__
+/* Low 32 bits of each lane's product, SSE2 only multiplies even lanes */
+static __m128i MulLo32(__m128i a, __m128i b)
+{
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32),\
+                                _mm_srli_epi64(b, 32));
+
+    /* Gather the low halves of the 4 products back into lane order */
+    even = _mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0));
+    odd = _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0));
+    return _mm_unpacklo_epi32(even, odd);
+}
+
+/* Mix32Lane for four words at once, lane i of words[j] is word i's j'th
+ * 32 bit word */
+static __m128i Mix32Lanes(__m128i *words, __m128i lens, unsigned int seed)
+{
+    __m128i hash = _mm_xor_si128(_mm_set1_epi32((int)seed),
+                                 MulLo32(lens, _mm_set1_epi32((int)MXLEN)));
+    __m128i mul = _mm_set1_epi32((int)MXMUL);
+    int i;
+
+    for (i = 0; i < KEYWIDTH / 4; i++) {
+        hash = _mm_xor_si128(hash, words[i]);
+        hash = MulLo32(hash, mul);
+        hash = _mm_xor_si128(hash, _mm_srli_epi32(hash, 15));
+    }
+
+    hash = _mm_xor_si128(hash, _mm_srli_epi32(hash, 16));
+    hash = MulLo32(hash, _mm_set1_epi32((int)MXFMIX1));
+    hash = _mm_xor_si128(hash, _mm_srli_epi32(hash, 13));
+    hash = MulLo32(hash, _mm_set1_epi32((int)MXFMIX2));
+    hash = _mm_xor_si128(hash, _mm_srli_epi32(hash, 16));
+    return hash;
+}
+#endif
+
+/* HashMix32 for many words. With SSE2, groups of 4 padded words are
+ * transposed so each vector holds the same 32 bit word of all 4, then both
+ * lanes are mixed for all 4 words at once */
+void HashBatchMix32(const HashFamily *family, char **words, int num_words,
+                    uint64_t seed, uint64_t *hashes)
+{
+    int i = 0;
+#ifdef __SSE2__
+    unsigned char blocks[4][KEYWIDTH];
+    unsigned int lens[4], low[4], high[4];
+    __m128i rows[4], pairs[4], columns[4];
+    int j;
+
+    for (; i + 4 <= num_words; i += 4) {
+        for (j = 0; j < 4; j++) {
+            lens[j] = PadWord(words[i + j], blocks[j]);
+            rows[j] = _mm_loadu_si128((__m128i *)blocks[j]);
+        }
+
+        /* 4 x 4 transpose of 32 bit words */
+        pairs[0] = _mm_unpacklo_epi32(rows[0], rows[1]);
+        pairs[1] = _mm_unpacklo_epi32(rows[2], rows[3]);
+        pairs[2] = _mm_unpackhi_epi32(rows[0], rows[1]);
+        pairs[3] = _mm_unpackhi_epi32(rows[2], rows[3]);
+        columns[0] = _mm_unpacklo_epi64(pairs[0], pairs[1]);
+        columns[1] = _mm_unpackhi_epi64(pairs[0], pairs[1]);
+        columns[2] = _mm_unpacklo_epi64(pairs[2], pairs[3]);
+        columns[3] = _mm_unpackhi_epi64(pairs[2], pairs[3]);
+
+        _mm_storeu_si128((__m128i *)low,\
+            Mix32Lanes(columns, _mm_loadu_si128((__m128i *)lens),\
+                       (unsigned int)seed));
+        _mm_storeu_si128((__m128i *)high,\
+            Mix32Lanes(columns, _mm_loadu_si128((__m128i *)lens),\
+                       (unsigned int)(seed >> 32) ^ MXHIGHSEED));
+
+        for (j = 0; j < 4; j++) {
+            hashes[i + j] = ((uint64_t)high[j] << 32) | low[j];
+        }
+    }
+#endif
+    /* Any words left over are hashed one at a time */
+    HashBatchScalar(family, words + i, num_words - i, seed, hashes + i);
+}
@@ -0,0 +1,115 @@
+#include "engine.h"
+
+double HashSearchTest(HashData *hashdata, char *filename)
+{
+    char word_buf[BATCHSIZE][MAXWORDLEN];
+    char *batch[BATCHSIZE];
+    char *mapped_word;
+    int total_lookups = 0;
+    int count = 0;
+    int batch_count = 0;
+    MapFile test_map;
+
+    FILE *test_file;
+
+    if (hashdata->num_threads > 1) {
+        return ParallelSearchTest(hashdata, filename);
+    }
+
+    /* Search for the words where they lie in the mapped test_file */
+    if (MapWordFile(&test_map, filename)) {
+        while ((mapped_word = NextMappedWord(&test_map)) != NULL) {
+            if (hashdata->batch_lookups) {
+                /* Gather words until a whole batch can be looked up */
+                batch[batch_count] = mapped_word;
+                batch_count++;
+                if (batch_count == BATCHSIZE) {
+                    total_lookups +=\
+                        WordSearchBatch(hashdata, batch, batch_count);
+                    batch_count = 0;
+                }
+            }
+            else {
+                total_lookups += WordSearch(hashdata, mapped_word);
+            }
+            count++;
+        }
+        /* Any last, partly filled batch */
+        if (batch_count > 0) {
+            total_lookups += WordSearchBatch(hashdata, batch, batch_count);
+        }
+        UnmapWordFile(&test_map);
+    }
+    else {
+        /* Open test_file file, exit if fopen fails */
+        test_file = fopen(filename, "r");
+        if (test_file == NULL) {
+            fprintf(stderr, ERR_FOPEN_FAIL);
+            exit(fopen_fail);
+        }
+
+        /* Load word and search for it in the hashtable, repeat for all.
+         * Batched words get a buffer each */
+        LoadNextWord(word_buf[batch_count], test_file);
+        while (word_buf[batch_count][0] != '\0') {
+            if (hashdata->batch_lookups) {
+                batch[batch_count] = word_buf[batch_count];
+                batch_count++;
+                if (batch_count == BATCHSIZE) {
+                    total_lookups +=\
+                        WordSearchBatch(hashdata, batch, batch_count);
+                    batch_count = 0;
+                }
+            }
+            else {
+                total_lookups += WordSearch(hashdata, word_buf[0]);
+            }
+            count++;
+            LoadNextWord(word_buf[batch_count], test_file);
+        }
+        /* Any last, partly filled batch */
+        if (batch_count > 0) {
+            total_lookups += WordSearchBatch(hashdata, batch, batch_count);
+        }
+
+        /* Exit if fclose fails */
+        if (fclose(test_file) != 0) {
+            fprintf(stderr, ERR_FCLOSE_FAIL);
+            exit(fclose_fail);
+        }
+    }
+
+    /* Exit if no words were found in test_file */
+    if (count == 0) {
+        fprintf(stderr, ERR_EMPTY_FILE);
+        exit(search_file_empty);
+    }
+
+    return (double) total_lookups / count;
+}
+
+int WordSearch(HashData *hashdata, char *curr_word) {
+
+    int counter = FindWord(hashdata, curr_word);
+
+    if (counter == NOTFOUND) {
+        fprintf(stderr, ERR_WORD_MISSING);
+        exit(word_not_found);
+    }
+
+    return counter;
+}
+
+/* Looks up to BATCHSIZE words together, returning their total lookups. The
+ * engine's FindWordBatch overlaps the words' cache misses */
+int WordSearchBatch(HashData *hashdata, char **words, int num_words)
+{
+    int total_lookups = FindWordBatch(hashdata, words, num_words);
+
+    if (total_lookups == NOTFOUND) {
+        fprintf(stderr, ERR_WORD_MISSING);
+        exit(word_not_found);
+    }
+
+    return total_lookups;
+}
@@ -0,0 +1,186 @@
+/* Shared by the engines from p4 on, which differ only in their tables. Each
+ * engine directory holds its table's header & source, and an engine.h
+ * naming that header for the sources here. An engine is built from its own
+ * sources & these with both directories on the include path, as
+ * bench/bench.sh does */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+#define MAXWORDLEN 15
+#define ARENASTARTSIZE 65536
+#define BATCHSIZE 16
+#define MAXTHREADS 256
+#define NOTFOUND (-1)
+#define KEYWIDTH 16
+#define DEFAULTSEED UINT64_C(0x9E3779B97F4A7C15)
+#define TIMERSAMPLES 1000
+#define PERFEVENTS 6
+#define LINESCANBLOCK 65536
+
+/* Software prefetch hint, a no-op on compilers without the builtin */
+#ifdef __GNUC__
+#define PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define PREFETCH(addr) ((void)(addr))
+#endif
+
+/* Error Print Statements */
+#define ERR_NO_FILE      "ERROR - 2 filenames need to be passed to the program.\n"
+#define ERR_FOPEN_FAIL   "ERROR - Failed to open the specified file.\n"
+#define ERR_FCLOSE_FAIL  "ERROR - Failed to close the specified file.\n"
+#define ERR_WORD_MISSING "ERROR - A word was not found in the hash table.\n"
+#define ERR_EMPTY_FILE   "ERROR - No words were found in the test search file.\n"
+#define ERR_LONG_STR     "ERROR - A word in the dictionary is > MAXWORDLEN.\n"
+#define ERR_NO_MEMORY    "ERROR - Failed to allocate memory for the hash table.\n"
+#define ERR_BAD_HASH     "ERROR - Unknown hash function name passed to -hash.\n"
+#define ERR_THREAD_FAIL  "ERROR - Failed to start a search thread.\n"
+#define ERR_BAD_OPTION   "ERROR - Unrecognised option passed to the program.\n"
+
+/* Bump allocated store for all words, slots hold offsets into it */
+typedef struct StringArena {
+    char *text;
+    unsigned int used;
+    unsigned int size;
+    int mapped;
+} StrArena;
+
+/* A selectable hash function, folded to 32 bits for the table. hash_batch
+ * hashes many words at once */
+typedef struct HashFamilyEntry HashFamily;
+typedef uint64_t (*WordHashFunc)(char *str, uint64_t seed);
+typedef void (*WordHashBatchFunc)(const HashFamily *family, char **words,
+                                  int num_words, uint64_t seed,
+                                  uint64_t *hashes);
+struct HashFamilyEntry {
+    char *name;
+    WordHashFunc hash;
+    WordHashBatchFunc hash_batch;
+};
+
+/* A word file mapped into memory, words are filtered & terminated in place */
+typedef struct MappedWordFile {
+    char *text;
+    size_t size;
+    size_t pos;
+} MapFile;
+
+/* One perf_event_open counter per event, -1 if it could not be opened,
+ * & the counts from the last PerfStop, -1 if not counted */
+typedef struct PerfCounterSet {
+    int fds[PERFEVENTS];
+    double counts[PERFEVENTS];
+} PerfCounters;
+
+/* Each engine's table, defined in its own header. Besides the table itself
+ * it holds the fields the shared sources use: arena, word_count,
+ * table_size, hash_family, hash_seed, resize_count, resize_seconds,
+ * presize, batch_lookups, num_threads & perf_counters */
+typedef struct HashTableData HashData;
+
+/* Every word of a test file, gathered so it can be split between threads.
+ * Words point into the mapped file, or into buf when it could not be mapped */
+typedef struct TestWordList {
+    char **words;
+    int count;
+    MapFile map;
+    char *buf;
+} WordList;
+
+/* One search thread's share of the words, and what it found */
+typedef struct SearchWorkerData {
+    HashData *hashdata;
+    char **words;
+    int num_words;
+    double total_lookups;
+    int status;
+} SearchWorker;
+
+enum Exit_Codes {
+    no_file_passed = 5,
+    fopen_fail = 6,
+    fclose_fail = 7,
+    hash_table_full = 8,
+    word_not_found = 9,
+    search_file_empty = 10,
+    str_too_long = 11,
+    out_of_memory = 12,
+    bad_option = 13,
+    thread_fail = 14
+};
+
+enum Boolean {
+    false,
+    true
+};
+
+/* The engine's table, in its own source */
+void InitHashData(HashData *hashdata, int size);
+void CreateHashTable(HashData *hashdata, char *filename);
+int AddArenaWord(HashData *hashdata, unsigned int offset);
+void ReserveCapacity(HashData *hashdata, long capacity);
+void FreeHashTable(HashData *hashdata);
+int FindWord(HashData *hashdata, char *curr_word);
+int FindWordBatch(HashData *hashdata, char **words, int num_words);
+uint64_t HashClassic(char *str, uint64_t seed);
+void ReportTable(HashData *hashdata);
+void ReportTableJson(HashData *hashdata);
+/* Word files & the arena, words.c */
+void ReadDictionary(HashData *hashdata, char *filename);
+void LoadNextWord(char *curr_word, FILE *txt_file);
+int MapWordFile(MapFile *map_file, char *filename);
+char *NextMappedWord(MapFile *map_file);
+void UnmapWordFile(MapFile *map_file);
+int AddToHashTable(HashData *hashdata, char *curr_word);
+unsigned int ArenaAddWord(StrArena *arena, char *curr_word);
+char *ArenaGrow(StrArena *arena);
+long CountLines(char *text, size_t size);
+long CountFileLines(char *filename);
+/* Single threaded search, search.c */
+double HashSearchTest(HashData *hashdata, char *filename);
+int WordSearch(HashData *hashdata, char *curr_word);
+int WordSearchBatch(HashData *hashdata, char **words, int num_words);
+/* Multi-threaded search, psearch.c */
+double ParallelSearchTest(HashData *hashdata, char *filename);
+void LoadWordList(WordList *word_list, char *filename);
+void FreeWordList(WordList *word_list);
+void *SearchWorkerMain(void *worker_data);
+/* Hardware event counters, perf.c */
+void PerfOpen(PerfCounters *perf);
+void PerfStart(PerfCounters *perf);
+void PerfStop(PerfCounters *perf);
+void PerfClose(PerfCounters *perf);
+void PrintPerfJson(PerfCounters *perf, char *name, double keys);
+/* Benchmark mode & timing, bench.c */
+void RunBenchmark(HashData *hashdata, char *dict_name, char *test_name);
+double WallSeconds(void);
+double TimerOverhead(void);
+int CompareDoubles(const void *a, const void *b);
+double Percentile(double *sorted, int count, double fraction);
+void PrintJsonString(char *str);
+/* Hash function family, hashfuncs.c */
+extern const HashFamily HashFamilies[];
+const HashFamily *FindHashFamily(char *name);
+unsigned int PadWord(char *str, unsigned char *block);
+void Mul128(uint64_t a, uint64_t b, uint64_t *low, uint64_t *high);
+uint64_t MulFold64(uint64_t a, uint64_t b);
+uint64_t Read64(unsigned char *bytes);
+uint64_t HashWy(char *str, uint64_t seed);
+uint64_t HashXxh3(char *str, uint64_t seed);
+unsigned int Mix32Lane(unsigned int *words, unsigned int len,
+                       unsigned int seed);
+uint64_t HashMix32(char *str, uint64_t seed);
+void HashBatchScalar(const HashFamily *family, char **words, int num_words,
+                     uint64_t seed, uint64_t *hashes);
+void HashBatchMix32(const HashFamily *family, char **words, int num_words,
+                    uint64_t seed, uint64_t *hashes);
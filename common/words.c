@@ -0,0 +1,278 @@
+#include "engine.h"
+
+/* Adds every word of the dictionary file to the table. Words from earlier
+ * calls are kept */
+void ReadDictionary(HashData *hashdata, char *filename)
+{
+    char curr_word[MAXWORDLEN];
+    char *mapped_word;
+    MapFile dict_map;
+
+    FILE *dict_file;
+
+    /* Map an empty table's dictionary in & use it as the arena, so words
+     * are hashed where they lie in the file rather than being copied */
+    if (hashdata->arena.used == 0 && MapWordFile(&dict_map, filename)) {
+        /* Every line is at most one word, so one resize makes room for all */
+        if (hashdata->presize) {
+            ReserveCapacity(hashdata, hashdata->word_count +\
+                            CountLines(dict_map.text, dict_map.size));
+        }
+        free(hashdata->arena.text);
+        hashdata->arena.text = dict_map.text;
+        hashdata->arena.used = (unsigned int)dict_map.size;
+        hashdata->arena.size = (unsigned int)dict_map.size;
+        hashdata->arena.mapped = true;
+
+        while ((mapped_word = NextMappedWord(&dict_map)) != NULL) {
+            AddArenaWord(hashdata,\
+                (unsigned int)(mapped_word - hashdata->arena.text));
+        }
+        return;
+    }
+
+    if (hashdata->presize) {
+        ReserveCapacity(hashdata,\
+                        hashdata->word_count + CountFileLines(filename));
+    }
+
+    /* Open dictionary file, exit if fopen fails */
+    dict_file = fopen(filename, "r");
+    if (dict_file == NULL) {
+        fprintf(stderr, ERR_FOPEN_FAIL);
+        exit(fopen_fail);
+    }
+
+    /* Load in next word & add it to the hash table, repeat for all words */
+    LoadNextWord(curr_word, dict_file);
+    while (curr_word[0] != '\0') {
+        AddToHashTable(hashdata, curr_word);
+        LoadNextWord(curr_word, dict_file);
+    }
+
+    if (fclose(dict_file) != 0) {
+        fprintf(stderr, ERR_FCLOSE_FAIL);
+        exit(fclose_fail);
+    }
+}
+
+/* Copies the next word from file into the curr_word string */
+void LoadNextWord(char *curr_word, FILE *txt_file)
+{
+    int counter = 0;
+    char c;
+
+    while ((c = getc(txt_file)) != '\n' && c != EOF) {
+        if (isalpha(c) != 0) {
+            curr_word[counter] = c;
+            counter++;
+
+            if (counter > MAXWORDLEN - 1) {
+                fprintf(stderr, ERR_LONG_STR);
+                exit(str_too_long);
+            }
+        }
+    }
+    curr_word[counter] = '\0';
+}
+
+/* Maps a word file into memory, returning false if the caller should fall
+ * back to reading it with LoadNextWord instead */
+int MapWordFile(MapFile *map_file, char *filename)
+{
+    struct stat file_stat;
+    int fd = open(filename, O_RDONLY);
+
+    /* Exit if the file cannot be opened, the same as a failed fopen */
+    if (fd < 0) {
+        fprintf(stderr, ERR_FOPEN_FAIL);
+        exit(fopen_fail);
+    }
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0 ||
+        (unsigned long)file_stat.st_size >= 0xFFFFFFFFu) {
+        close(fd);
+        return false;
+    }
+    map_file->size = (size_t)file_stat.st_size;
+    map_file->pos = 0;
+
+    /* Private writable pages let words be terminated in place, the file on
+     * disk is never modified */
+    map_file->text = mmap(NULL, map_file->size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map_file->text == MAP_FAILED) {
+        map_file->text = NULL;
+        return false;
+    }
+
+    /* With no final newline the last word is terminated in the page's spare
+     * tail, which does not exist if the file fills its last page exactly */
+    if (map_file->text[map_file->size - 1] != '\n' &&
+        map_file->size % sysconf(_SC_PAGESIZE) == 0) {
+        UnmapWordFile(map_file);
+        return false;
+    }
+    posix_madvise(map_file->text, map_file->size, POSIX_MADV_SEQUENTIAL);
+
+    return true;
+}
+
+/* Returns the next word of the mapped file, or NULL at the end. Non alpha
+ * characters are squeezed out in place and the newline becomes the '\0' */
+char *NextMappedWord(MapFile *map_file)
+{
+    char *curr_word = map_file->text + map_file->pos;
+    char *line_end;
+    int counter = 0;
+    size_t i, line_len;
+
+    if (map_file->pos >= map_file->size) {
+        return NULL;
+    }
+
+    /* Find the whole line in one pass, rather than a char at a time */
+    line_end = memchr(curr_word, '\n', map_file->size - map_file->pos);
+    if (line_end == NULL) {
+        line_len = map_file->size - map_file->pos;
+        map_file->pos = map_file->size;
+    }
+    else {
+        line_len = line_end - curr_word;
+        map_file->pos += line_len + 1;
+    }
+
+    for (i = 0; i < line_len; i++) {
+        if (isalpha((unsigned char)curr_word[i]) != 0) {
+            curr_word[counter] = curr_word[i];
+            counter++;
+
+            if (counter > MAXWORDLEN - 1) {
+                fprintf(stderr, ERR_LONG_STR);
+                exit(str_too_long);
+            }
+        }
+    }
+    curr_word[counter] = '\0';
+
+    /* An empty line ends the word list, the same as LoadNextWord */
+    if (counter == 0) {
+        map_file->pos = map_file->size;
+        return NULL;
+    }
+
+    return curr_word;
+}
+
+void UnmapWordFile(MapFile *map_file)
+{
+    munmap(map_file->text, map_file->size);
+    map_file->text = NULL;
+    map_file->size = 0;
+}
+
+/* Copies the current word into the arena, then places it in the hash table.
+ * Returns false, giving the arena space back, if the table turned it away */
+int AddToHashTable(HashData *hashdata, char *curr_word)
+{
+    unsigned int offset = ArenaAddWord(&hashdata->arena, curr_word);
+
+    if (!AddArenaWord(hashdata, offset)) {
+        hashdata->arena.used = offset;
+        return false;
+    }
+    return true;
+}
+
+/* Copies a word to the end of the arena, returning its offset */
+unsigned int ArenaAddWord(StrArena *arena, char *curr_word)
+{
+    unsigned int len = (unsigned int)strlen(curr_word) + 1;
+    unsigned int offset = arena->used;
+
+    /* Double the arena when full, offsets stay valid across the realloc */
+    if (arena->used + len > arena->size) {
+        if (arena->size > 0xFFFFFFFFu / 2) {
+            fprintf(stderr, ERR_NO_MEMORY);
+            exit(out_of_memory);
+        }
+        arena->size *= 2;
+        arena->text = ArenaGrow(arena);
+        if (arena->text == NULL) {
+            fprintf(stderr, ERR_NO_MEMORY);
+            exit(out_of_memory);
+        }
+    }
+    memcpy(arena->text + offset, curr_word, len);
+    arena->used += len;
+
+    return offset;
+}
+
+/* Reallocates the arena text at its new size. A mapped dictionary is copied
+ * onto the heap first, keeping every offset into it valid */
+char *ArenaGrow(StrArena *arena)
+{
+    char *heap_text;
+
+    if (!arena->mapped) {
+        return realloc(arena->text, arena->size);
+    }
+
+    heap_text = malloc(arena->size);
+    if (heap_text != NULL) {
+        memcpy(heap_text, arena->text, arena->used);
+        munmap(arena->text, arena->used);
+        arena->mapped = false;
+    }
+    return heap_text;
+}
+
+/* Counts the lines of a block of text, including a last unterminated one */
+long CountLines(char *text, size_t size)
+{
+    char *pos = text, *end = text + size;
+    long lines = 0;
+
+    while ((pos = memchr(pos, '\n', end - pos)) != NULL) {
+        lines++;
+        pos++;
+    }
+    if (size > 0 && text[size - 1] != '\n') {
+        lines++;
+    }
+    return lines;
+}
+
+/* Counts the lines of a file, reading it in blocks to find the newlines */
+long CountFileLines(char *filename)
+{
+    char block[LINESCANBLOCK];
+    size_t block_len;
+    long lines = 0;
+    int open_line = false;
+    FILE *txt_file = fopen(filename, "r");
+
+    if (txt_file == NULL) {
+        fprintf(stderr, ERR_FOPEN_FAIL);
+        exit(fopen_fail);
+    }
+
+    while ((block_len = fread(block, 1, LINESCANBLOCK, txt_file)) > 0) {
+        /* A line split between blocks is only counted once it ends */
+        lines += CountLines(block, block_len);
+        open_line = block[block_len - 1] != '\n';
+        if (open_line) {
+            lines--;
+        }
+    }
+    if (open_line) {
+        lines++;
+    }
+
+    if (fclose(txt_file) != 0) {
+        fprintf(stderr, ERR_FCLOSE_FAIL);
+        exit(fclose_fail);
+    }
+    return lines;
+}
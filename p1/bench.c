@@ -0,0 +1,164 @@
+#include "dhash.h"
+
+/* Builds the table from the dictionary & replays the test words against it,
+ * printing one JSON object of timings, probe lengths & memory use */
+void RunBenchmark(HashData *hashdata, char *dict_name, char *test_name)
+{
+    WordList word_list;
+    PerfCounters perf, build_perf;
+    struct rusage usage;
+    double *latencies;
+    double start, build_seconds, search_seconds, timer_seconds;
+    double total_probes = 0, total_squares = 0, mean_probes;
+    int i, counter, batch_count, max_probes = 0;
+
+    /* Opened before the build so opening is not counted against it */
+    if (hashdata->perf_counters) {
+        PerfOpen(&perf);
+        PerfStart(&perf);
+    }
+    start = WallSeconds();
+    CreateHashTable(hashdata, dict_name);
+    build_seconds = WallSeconds() - start;
+    if (hashdata->perf_counters) {
+        PerfStop(&perf);
+        build_perf = perf;
+    }
+    /* The batched lookups assume no migration is under way */
+    FinishResize(hashdata);
+
+    LoadWordList(&word_list, test_name);
+    if (word_list.count == 0) {
+        fprintf(stderr, ERR_EMPTY_FILE);
+        exit(search_file_empty);
+    }
+    latencies = (double *)malloc(word_list.count * sizeof(double));
+    if (latencies == NULL) {
+        fprintf(stderr, ERR_NO_MEMORY);
+        exit(out_of_memory);
+    }
+
+    /* Throughput pass, the words back to back with no timer in the loop */
+    if (hashdata->perf_counters) {
+        PerfStart(&perf);
+    }
+    start = WallSeconds();
+    for (i = 0; i < word_list.count; i += batch_count) {
+        if (hashdata->batch_lookups) {
+            batch_count = word_list.count - i < BATCHSIZE ?\
+                word_list.count - i : BATCHSIZE;
+            counter = FindWordBatch(hashdata, word_list.words + i,\
+                                    batch_count);
+        }
+        else {
+            batch_count = 1;
+            counter = FindWord(hashdata, word_list.words[i]);
+        }
+        if (counter == NOTFOUND) {
+            fprintf(stderr, ERR_WORD_MISSING);
+            exit(word_not_found);
+        }
+    }
+    search_seconds = WallSeconds() - start;
+    if (hashdata->perf_counters) {
+        PerfStop(&perf);
+        PerfClose(&perf);
+    }
+
+    /* Latency pass, each lookup timed on its own less the clock's cost */
+    timer_seconds = TimerOverhead();
+    for (i = 0; i < word_list.count; i++) {
+        start = WallSeconds();
+        counter = FindWord(hashdata, word_list.words[i]);
+        latencies[i] = WallSeconds() - start - timer_seconds;
+
+        total_probes += counter;
+        total_squares += (double)counter * counter;
+        if (counter > max_probes) {
+            max_probes = counter;
+        }
+    }
+    qsort(latencies, word_list.count, sizeof(double), CompareDoubles);
+
+    getrusage(RUSAGE_SELF, &usage);
+    mean_probes = total_probes / word_list.count;
+
+    printf("{\"engine\": \"%s\", \"dict\": ", ENGINENAME);
+    PrintJsonString(dict_name);
+    printf(", \"queries\": ");
+    PrintJsonString(test_name);
+    printf(", \"hash\": \"%s\", \"batch\": %d, \"incremental\": %d, "
+           "\"words\": %d, \"table_size\": %d, \"build_seconds\": %f, "
+           "\"resizes\": %d, \"resize_seconds\": %f, \"lookups\": %d, "
+           "\"lookups_per_sec\": %.0f, \"latency_ns\": {\"p50\": %.1f, "
+           "\"p99\": %.1f, \"p999\": %.1f}, \"avg_probes\": %f, "
+           "\"probe_variance\": %f, \"max_probes\": %d, "
+           "\"timer_ns\": %.1f, \"peak_rss_kb\": %ld",
+           hashdata->hash_family->name, hashdata->batch_lookups,
+           hashdata->incremental,
+           hashdata->word_count, hashdata->table_size, build_seconds,
+           hashdata->resize_count, hashdata->resize_seconds,
+           word_list.count, word_list.count / search_seconds,
+           Percentile(latencies, word_list.count, 0.5) * 1e9,
+           Percentile(latencies, word_list.count, 0.99) * 1e9,
+           Percentile(latencies, word_list.count, 0.999) * 1e9,
+           mean_probes, total_squares / word_list.count -\
+           mean_probes * mean_probes, max_probes,
+           timer_seconds * 1e9, usage.ru_maxrss);
+    if (hashdata->perf_counters) {
+        PrintPerfJson(&build_perf, "perf_build", hashdata->word_count);
+        PrintPerfJson(&perf, "perf_search", word_list.count);
+    }
+    printf("}\n");
+
+    free(latencies);
+    FreeWordList(&word_list);
+}
+
+/* The cheapest of many back to back clock reads */
+double TimerOverhead(void)
+{
+    double start, elapsed, cheapest = 1;
+    int i;
+
+    for (i = 0; i < TIMERSAMPLES; i++) {
+        start = WallSeconds();
+        elapsed = WallSeconds() - start;
+        if (elapsed < cheapest) {
+            cheapest = elapsed;
+        }
+    }
+    return cheapest;
+}
+
+/* qsort comparison for ascending doubles */
+int CompareDoubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* The value below which the given fraction of the sorted values fall */
+double Percentile(double *sorted, int count, double fraction)
+{
+    return sorted[(int)(fraction * (count - 1))];
+}
+
+/* Prints a file name as a quoted JSON string */
+void PrintJsonString(char *str)
+{
+    putchar('"');
+    for (; *str != '\0'; str++) {
+        if (*str == '"' || *str == '\\') {
+            putchar('\\');
+        }
+        if ((unsigned char)*str < 0x20) {
+            printf("\\u%04x", (unsigned char)*str);
+        }
+        else {
+            putchar(*str);
+        }
+    }
+    putchar('"');
+}
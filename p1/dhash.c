@@ -1,22 +1,192 @@
 #include "dhash.h"
 
 #define PRIME 31
+#define LADDERSTEPS (int)(sizeof(PrimeLadder) / sizeof(PrimeLadder[0]))
+
+/* Each prime is the next prime >= twice the one before it, so growing the
+ * table steps up one rung instead of searching for primes at runtime.
+ * Multipliers are 2^64 / d + 1 for d = prime and d = prime - 1 */
+static const PrimeStep PrimeLadder[] = {
+    {         5, UINT64_C(0x3333333333333334), UINT64_C(0x4000000000000000)},
+    {        11, UINT64_C(0x1745D1745D1745D2), UINT64_C(0x199999999999999A)},
+    {        23, UINT64_C(0x0B21642C8590B217), UINT64_C(0x0BA2E8BA2E8BA2E9)},
+    {        53, UINT64_C(0x04D4873ECADE304E), UINT64_C(0x04EC4EC4EC4EC4ED)},
+    {       113, UINT64_C(0x0243F6F0243F6F03), UINT64_C(0x024924924924924A)},
+    {       251, UINT64_C(0x0105197F7D734042), UINT64_C(0x010624DD2F1A9FBF)},
+    {       503, UINT64_C(0x00824A4E60B3262C), UINT64_C(0x00828CBFBEB9A021)},
+    {      1009, UINT64_C(0x0040F391612C6681), UINT64_C(0x0041041041041042)},
+    {      2027, UINT64_C(0x002054DEC8CF1FB4), UINT64_C(0x002058F4A0B9FF7F)},
+    {      4057, UINT64_C(0x0010275FF9F13C03), UINT64_C(0x00102864FC7729E9)},
+    {      8117, UINT64_C(0x000812EC59F2D11B), UINT64_C(0x0008132D8C2CEAAE)},
+    {     16249, UINT64_C(0x00040881F21AB04C), UINT64_C(0x0004089236B43F06)},
+    {     32503, UINT64_C(0x0002042CA46C6871), UINT64_C(0x00020430B53899A0)},
+    {     65011, UINT64_C(0x000102113D5AD344), UINT64_C(0x0001021241829A5A)},
+    {    130027, UINT64_C(0x0000810759802C1B), UINT64_C(0x000081079A88B54B)},
+    {    260081, UINT64_C(0x00004081F5D2FFD7), UINT64_C(0x00004082061440D3)},
+    {    520193, UINT64_C(0x000020407CF1D40A), UINT64_C(0x0000204081020409)},
+    {   1040387, UINT64_C(0x000010203D74DE37), UINT64_C(0x000010203E78EA05)},
+    {   2080777, UINT64_C(0x000008101DF76660), UINT64_C(0x000008101E386945)},
+    {   4161557, UINT64_C(0x000004080ECAF108), UINT64_C(0x000004080EDB31BF)},
+    {   8323151, UINT64_C(0x0000020406CF2211), UINT64_C(0x0000020406D3323C)},
+    {  16646317, UINT64_C(0x0000010203585467), UINT64_C(0x0000010203595871)},
+    {  33292687, UINT64_C(0x00000081019EB4A7), UINT64_C(0x00000081019EF5A9)},
+    {  66585377, UINT64_C(0x0000004080CF2992), UINT64_C(0x0000004080CF39D2)},
+    { 133170769, UINT64_C(0x00000020406757D7), UINT64_C(0x0000002040675BE7)},
+    { 266341583, UINT64_C(0x0000001020337E36), UINT64_C(0x0000001020337F3A)},
+    { 532683227, UINT64_C(0x000000081019AF9D), UINT64_C(0x000000081019AFDE)},
+    {1065366479, UINT64_C(0x00000004080CD639), UINT64_C(0x00000004080CD649)},
+    {2130732959, UINT64_C(0x0000000204066B19), UINT64_C(0x0000000204066B1D)},
+};
 
 void InitHashData(HashData *hashdata, int size)
 {
-    int prime_size = PrimeReturn(size);
+#ifdef TABLE_STATS
+    hashdata->stats = (TableStats *)calloc(1, sizeof(TableStats));
+    if (hashdata->stats == NULL) {
+        fprintf(stderr, ERR_NO_MEMORY);
+        exit(out_of_memory);
+    }
+#endif
+
+    /* Start with an empty string arena, words are bump allocated into it */
+    hashdata->arena.text = malloc(ARENASTARTSIZE);
+    if (hashdata->arena.text == NULL) {
+        fprintf(stderr, ERR_NO_MEMORY);
+        exit(out_of_memory);
+    }
+    STATSBYTES(hashdata, ARENASTARTSIZE);
+    hashdata->arena.used = 0;
+    hashdata->arena.size = ARENASTARTSIZE;
+    hashdata->arena.mapped = false;
+    hashdata->word_count = 0;
+    hashdata->max_load_fraction = MAXLOADFRACTION;
+    hashdata->hash_family = &HashFamilies[0];
+    hashdata->hash_seed = DEFAULTSEED;
+    hashdata->incremental = false;
+    hashdata->old_hash_table = NULL;
+    hashdata->old_prime_index = 0;
+    hashdata->old_table_size = 0;
+    hashdata->migrate_pos = 0;
+    hashdata->robin_hood = false;
+    hashdata->resize_count = 0;
+    hashdata->resize_seconds = 0;
+    hashdata->presize = false;
+    hashdata->snapshot_name = NULL;
+    hashdata->snapshot = NULL;
+    hashdata->snapshot_size = 0;
+    hashdata->use_filter = false;
+    hashdata->filter.blocks = NULL;
+    hashdata->filter.num_blocks = 0;
+    hashdata->batch_lookups = false;
+    hashdata->num_threads = 1;
+    hashdata->perf_counters = false;
 
-    hashdata->hash_table = (char **)calloc(prime_size, sizeof(char *));
-    hashdata->table_size = prime_size;
-    hashdata->max_table_load = (int)(prime_size * MAXLOADFRACTION);
+    NewHashTable(hashdata, PrimeIndex(size));
 }
 
+/* Allocates an empty table of the ladder size, leaving the arena alone */
+void NewHashTable(HashData *hashdata, int prime_index)
+{
+    int size = PrimeLadder[prime_index].prime;
+
+    hashdata->hash_table = (HashSlot *)malloc(size * sizeof(HashSlot));
+    if (hashdata->hash_table == NULL) {
+        fprintf(stderr, ERR_NO_MEMORY);
+        exit(out_of_memory);
+    }
+    STATSBYTES(hashdata, size * sizeof(HashSlot));
+    /* Every byte EMPTYFILL marks every slot as empty */
+    memset(hashdata->hash_table, EMPTYFILL, size * sizeof(HashSlot));
+    hashdata->prime_index = prime_index;
+    hashdata->table_size = size;
+    hashdata->max_table_load = (int)(size * hashdata->max_load_fraction);
+    hashdata->deleted_count = 0;
+}
+
+/* Changes the load at which the table grows, for this table & later ones */
+void SetLoadFraction(HashData *hashdata, double load_fraction)
+{
+    hashdata->max_load_fraction = load_fraction;
+    hashdata->max_table_load = (int)(hashdata->table_size * load_fraction);
+}
+
+/* Builds the table from the dictionary file, or with a snapshot file set,
+ * maps the snapshot in if it is up to date & otherwise builds then saves it.
+ * Only an empty table is replaced by a snapshot. The word filter, if used,
+ * is built from the finished table */
 void CreateHashTable(HashData *hashdata, char *filename)
 {
-    int count = 0;
+    SnapHeader identity;
+
+    if (hashdata->snapshot_name == NULL || hashdata->word_count != 0 ||
+        !SnapshotIdentity(hashdata, filename, &identity)) {
+        BuildHashTable(hashdata, filename);
+    }
+    else if (!LoadSnapshot(hashdata, &identity)) {
+        BuildHashTable(hashdata, filename);
+        SaveSnapshot(hashdata, &identity);
+    }
+
+    if (hashdata->use_filter) {
+        BuildWordFilter(hashdata);
+    }
+}
+
+/* Adds every word of the dictionary file to the table */
+void BuildHashTable(HashData *hashdata, char *filename)
+{
     char curr_word[MAXWORDLEN];
+    char *mapped_word;
+    MapFile dict_map;
 
     FILE *dict_file;
+
+    /* Map an empty table's dictionary in & use it as the arena, so words
+     * are hashed where they lie in the file rather than being copied */
+    if (hashdata->arena.used == 0 && MapWordFile(&dict_map, filename)) {
+        /* Every line is at most one word, so one resize makes room for all */
+        if (hashdata->presize) {
+            ReserveCapacity(hashdata, hashdata->word_count +\
+                            CountLines(dict_map.text, dict_map.size));
+        }
+        free(hashdata->arena.text);
+        hashdata->arena.text = dict_map.text;
+        hashdata->arena.used = (unsigned int)dict_map.size;
+        hashdata->arena.size = (unsigned int)dict_map.size;
+        hashdata->arena.mapped = true;
+
+        while ((mapped_word = NextMappedWord(&dict_map)) != NULL) {
+            AddArenaWord(hashdata,\
+                (unsigned int)(mapped_word - hashdata->arena.text));
+
+            /* If the hash table is too full, rebuild table with 2x size */
+            if (hashdata->word_count + hashdata->deleted_count >\
+                hashdata->max_table_load) {
+                ResizeHashTable(hashdata);
+            }
+        }
+#ifdef INLINE_KEYS
+        /* Every key was copied into its slot, so the mapping can go */
+        FinishResize(hashdata);
+        munmap(hashdata->arena.text, hashdata->arena.used);
+        hashdata->arena.text = malloc(ARENASTARTSIZE);
+        if (hashdata->arena.text == NULL) {
+            fprintf(stderr, ERR_NO_MEMORY);
+            exit(out_of_memory);
+        }
+        STATSBYTES(hashdata, ARENASTARTSIZE);
+        hashdata->arena.used = 0;
+        hashdata->arena.size = ARENASTARTSIZE;
+        hashdata->arena.mapped = false;
+#endif
+        return;
+    }
+
+    if (hashdata->presize) {
+        ReserveCapacity(hashdata,\
+                        hashdata->word_count + CountFileLines(filename));
+    }
+
     /* Open dictionary file, exit if fopen fails */
     dict_file = fopen(filename, "r");
     if (dict_file == NULL) {
@@ -28,10 +198,10 @@ void CreateHashTable(HashData *hashdata, char *filename)
     LoadNextWord(curr_word, dict_file);
     while (curr_word[0] != '\0') {
         AddToHashTable(hashdata, curr_word);
-        count++;
 
         /* If the hash table is too full, rebuild table with 2x size */
-        if (count > hashdata->max_table_load) {
+        if (hashdata->word_count + hashdata->deleted_count >\
+            hashdata->max_table_load) {
             ResizeHashTable(hashdata);
         }
         LoadNextWord(curr_word, dict_file);
@@ -63,39 +233,227 @@ void LoadNextWord(char *curr_word, FILE *txt_file)
     curr_word[counter] = '\0';
 }
 
-/* Finds a hash for the current word, then places it in the hash table */
+/* Maps a word file into memory, returning false if the caller should fall
+ * back to reading it with LoadNextWord instead */
+int MapWordFile(MapFile *map_file, char *filename)
+{
+    struct stat file_stat;
+    int fd = open(filename, O_RDONLY);
+
+    /* Exit if the file cannot be opened, the same as a failed fopen */
+    if (fd < 0) {
+        fprintf(stderr, ERR_FOPEN_FAIL);
+        exit(fopen_fail);
+    }
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0 ||
+        (unsigned long)file_stat.st_size >= EMPTYSLOT) {
+        close(fd);
+        return false;
+    }
+    map_file->size = (size_t)file_stat.st_size;
+    map_file->pos = 0;
+
+    /* Private writable pages let words be terminated in place, the file on
+     * disk is never modified */
+    map_file->text = mmap(NULL, map_file->size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map_file->text == MAP_FAILED) {
+        return false;
+    }
+
+    /* With no final newline the last word is terminated in the page's spare
+     * tail, which does not exist if the file fills its last page exactly */
+    if (map_file->text[map_file->size - 1] != '\n' &&
+        map_file->size % sysconf(_SC_PAGESIZE) == 0) {
+        munmap(map_file->text, map_file->size);
+        return false;
+    }
+    posix_madvise(map_file->text, map_file->size, POSIX_MADV_SEQUENTIAL);
+
+    return true;
+}
+
+/* Returns the next word of the mapped file, or NULL at the end. Non alpha
+ * characters are squeezed out in place and the newline becomes the '\0' */
+char *NextMappedWord(MapFile *map_file)
+{
+    char *curr_word = map_file->text + map_file->pos;
+    char *line_end;
+    int counter = 0;
+    size_t i, line_len;
+
+    if (map_file->pos >= map_file->size) {
+        return NULL;
+    }
+
+    /* Find the whole line in one pass, rather than a char at a time */
+    line_end = memchr(curr_word, '\n', map_file->size - map_file->pos);
+    if (line_end == NULL) {
+        line_len = map_file->size - map_file->pos;
+        map_file->pos = map_file->size;
+    }
+    else {
+        line_len = line_end - curr_word;
+        map_file->pos += line_len + 1;
+    }
+
+    for (i = 0; i < line_len; i++) {
+        if (isalpha((unsigned char)curr_word[i]) != 0) {
+            curr_word[counter] = curr_word[i];
+            counter++;
+
+            if (counter > MAXWORDLEN - 1) {
+                fprintf(stderr, ERR_LONG_STR);
+                exit(str_too_long);
+            }
+        }
+    }
+    curr_word[counter] = '\0';
+
+    /* An empty line ends the word list, the same as LoadNextWord */
+    if (counter == 0) {
+        map_file->pos = map_file->size;
+        return NULL;
+    }
+
+    return curr_word;
+}
+
+void UnmapWordFile(MapFile *map_file)
+{
+    munmap(map_file->text, map_file->size);
+}
+
+/* Copies the current word into the arena, then places it in the hash table */
 void AddToHashTable(HashData *hashdata, char *curr_word)
 {
-    int hash1, hash2, hash_t;
+#ifdef INLINE_KEYS
+    /* The key ends up in the slot, so the arena only holds it meanwhile */
+    unsigned int offset = ArenaAddWord(hashdata, curr_word);
 
-    /* Calculate the hashes for the current word */
-    hash1 = HashFunc1(curr_word) % hashdata->table_size;
-    hash2 = (HashFunc2(curr_word) % (hashdata->table_size - 1)) + 1;
-    hash_t = hash1;
+    AddArenaWord(hashdata, offset);
+    hashdata->arena.used = offset;
+#else
+    AddArenaWord(hashdata, ArenaAddWord(hashdata, curr_word));
+#endif
+}
 
-    /* Loop taking hash2 away from hash_t until an empty space is found */
-    do {
-        /* If the location hash1 is free in the hash_table, add the word */
-        if (hashdata->hash_table[hash_t] == NULL) {
-            hashdata->hash_table[hash_t] =\
-                calloc(strlen(curr_word)+1, sizeof(char));
-            strcpy(hashdata->hash_table[hash_t], curr_word);
+/* Places a word that is already in the arena into the hash table */
+void AddArenaWord(HashData *hashdata, unsigned int offset)
+{
+    HashSlot slot;
+    uint64_t full_hash;
+    int probes;
 
-            return;
+    /* Pay off part of any resize still in progress */
+    if (hashdata->old_hash_table != NULL) {
+        MigrateStep(hashdata, MIGRATESTEP);
+    }
+
+    /* Hash the word once, the slot keeps both hashes from then on */
+    full_hash = hashdata->hash_family->hash(hashdata->arena.text + offset,\
+                                            hashdata->hash_seed);
+#ifdef INLINE_KEYS
+    PadWord(hashdata->arena.text + offset, slot.key);
+#else
+    slot.word = offset;
+#endif
+    slot.hash1 = (unsigned int)full_hash;
+    slot.hash2 = (unsigned int)(full_hash >> 32);
+    probes = InsertSlot(hashdata, &slot);
+    STATSCOUNT(hashdata, insert_probes, probes);
+    hashdata->word_count++;
+
+    if (hashdata->filter.blocks != NULL) {
+        FilterAdd(&hashdata->filter, full_hash);
+    }
+}
+
+/* Places a slot in the hash table using the full hashes it carries, in the
+ * first empty slot or tombstone. In Robin Hood mode it takes the place of
+ * any resident nearer its home slot, and the resident carries on along its
+ * own probe sequence instead. Returns the slots looked at */
+int InsertSlot(HashData *hashdata, HashSlot *slot)
+{
+    const PrimeStep *step = &PrimeLadder[hashdata->prime_index];
+    HashSlot carried = *slot, resident;
+    int hash2, hash_t, probes = 0;
+
+    /* Reduce the stored hashes to the current table size */
+    hash_t = FastMod(carried.hash1, step->mod_mult, step->prime);
+    hash2 = FastMod(carried.hash2, step->step_mod_mult, step->prime - 1) + 1;
+    carried.dist = 0;
+
+    /* Loop taking hash2 away from hash_t until an empty space is found. A
+     * prime table size means table_size steps visit every slot */
+    while (carried.dist < (unsigned int)hashdata->table_size) {
+        probes++;
+
+        /* If the location hash_t is free in the hash_table, add the word */
+        if (SLOTISEMPTY(hashdata->hash_table[hash_t])) {
+            hashdata->hash_table[hash_t] = carried;
+            return probes;
         }
 
+        /* A Robin Hood tombstone keeps its distance so searches still stop
+         * early, so is only reused by a word at least as far from home */
+        if (SLOTISDELETED(hashdata->hash_table[hash_t]) &&
+            (!hashdata->robin_hood ||
+             hashdata->hash_table[hash_t].dist <= carried.dist)) {
+            hashdata->hash_table[hash_t] = carried;
+            hashdata->deleted_count--;
+            return probes;
+        }
+
+        if (hashdata->robin_hood &&
+            hashdata->hash_table[hash_t].dist < carried.dist) {
+            resident = hashdata->hash_table[hash_t];
+            hashdata->hash_table[hash_t] = carried;
+            carried = resident;
+            hash2 = FastMod(carried.hash2, step->step_mod_mult,\
+                            step->prime - 1) + 1;
+        }
+
+        carried.dist++;
         hash_t -= hash2;
         /* If the hash goes below 0, wrap back past the end of the array */
         if (hash_t < 0) {
             hash_t += hashdata->table_size;
         }
     }
-    while (hash_t != hash1);
 
     fprintf(stderr, ERR_TABLE_FULL);
     exit(hash_table_full);
 }
 
+/* Bump allocates a copy of the word in the arena, returning its offset */
+unsigned int ArenaAddWord(HashData *hashdata, char *curr_word)
+{
+    StrArena *arena = &hashdata->arena;
+    unsigned int len = (unsigned int)strlen(curr_word) + 1;
+    unsigned int offset = arena->used;
+
+    /* Double the arena when full, offsets stay valid across the realloc */
+    if (arena->used + len > arena->size) {
+        if (arena->size > EMPTYSLOT / 2) {
+            fprintf(stderr, ERR_NO_MEMORY);
+            exit(out_of_memory);
+        }
+        arena->size *= 2;
+        arena->text = ArenaGrow(arena);
+        if (arena->text == NULL) {
+            fprintf(stderr, ERR_NO_MEMORY);
+            exit(out_of_memory);
+        }
+        STATSBYTES(hashdata, arena->size);
+    }
+    memcpy(arena->text + offset, curr_word, len);
+    arena->used += len;
+
+    return offset;
+}
+
 /* Calculates a hash using the start & end 2 chars and string length */
 unsigned int HashFunc1(char *str)
 {
@@ -107,7 +465,8 @@ unsigned int HashFunc1(char *str)
     c1 = str[0];
     c2 = str[1];
     cn1 = str[n - 1];
-    cn2 = str[n - 2];
+    /* A one letter word has no second last char, don't read before it */
+    cn2 = n > 1 ? str[n - 2] : 0;
 
     hash = (c1*c2 + cn1*cn2) * n;
 
@@ -128,79 +487,543 @@ unsigned int HashFunc2(char *str)
     return hash;
 }
 
-/* Creates a new larger hash table, moves the old values into the new table */
+/* Reallocates the arena text at its new size. A mapped dictionary is copied
+ * onto the heap first, keeping every offset into it valid */
+char *ArenaGrow(StrArena *arena)
+{
+    char *heap_text;
+
+    if (!arena->mapped) {
+        return realloc(arena->text, arena->size);
+    }
+
+    heap_text = malloc(arena->size);
+    if (heap_text != NULL) {
+        memcpy(heap_text, arena->text, arena->used);
+        munmap(arena->text, arena->used);
+        arena->mapped = false;
+    }
+    return heap_text;
+}
+
+/* The original pair of hashes as one family, HashFunc1 in the low half and
+ * HashFunc2 in the high half. Unseeded */
+uint64_t HashClassic(char *str, uint64_t seed)
+{
+    (void)seed;
+    return ((uint64_t)HashFunc2(str) << 32) | HashFunc1(str);
+}
+
+/* Creates a new larger hash table on the next rung of the ladder, unless it
+ * is tombstones rather than words filling the table, which are compacted */
 void ResizeHashTable(HashData *hashdata)
 {
-    char **old_hash_table = hashdata->hash_table;
-    int i, old_table_size = hashdata->table_size;
+    if (hashdata->word_count <= hashdata->max_table_load / 2) {
+        CompactTable(hashdata);
+    }
+    else {
+        RehashTable(hashdata, hashdata->prime_index + 1);
+    }
+}
+
+/* Creates a new hash table on the given rung, moves the old offsets into the
+ * new table. In incremental mode the old table is kept and drained by
+ * MigrateStep */
+void RehashTable(HashData *hashdata, int prime_index)
+{
+    HashSlot *old_hash_table;
+    int i, old_prime_index, old_table_size;
+    double start = WallSeconds();
+
+    /* A previous incremental resize must be finished before starting again */
+    FinishResize(hashdata);
+    old_hash_table = hashdata->hash_table;
+    old_prime_index = hashdata->prime_index;
+    old_table_size = hashdata->table_size;
+
+    if (prime_index >= LADDERSTEPS) {
+        fprintf(stderr, ERR_TABLE_MAX);
+        exit(hash_table_full);
+    }
     /* Create the new bigger hash table, currently empty */
-    InitHashData(hashdata, PrimeReturn(hashdata->table_size * SIZEINCREASE));
+    NewHashTable(hashdata, prime_index);
 
-    for (i = 0; i < old_table_size; i++) {
-        /* For each word in the old hash table, add to the new table */
-        if (old_hash_table[i] != NULL) {
-            AddToHashTable(hashdata, old_hash_table[i]);
+    if (hashdata->incremental) {
+        hashdata->old_hash_table = old_hash_table;
+        hashdata->old_prime_index = old_prime_index;
+        hashdata->old_table_size = old_table_size;
+        hashdata->migrate_pos = 0;
+    }
+    else {
+        for (i = 0; i < old_table_size; i++) {
+            /* Move each slot across by its stored hashes, strings never move */
+            if (SLOTHASWORD(old_hash_table[i])) {
+                InsertSlot(hashdata, &old_hash_table[i]);
+            }
         }
+        free(old_hash_table);
     }
-    FreeHashTable(old_hash_table, old_table_size);
+
+    /* Incremental migration is spread over later calls & not counted here */
+    hashdata->resize_count++;
+    hashdata->resize_seconds += WallSeconds() - start;
 }
 
-/* From a given input integer, find the next highest prime number */
-int PrimeReturn(int test)
+/* Moves up to max_slots slots of the old table into the new table. Moved
+ * slots are left in place so old probe sequences stay unbroken */
+void MigrateStep(HashData *hashdata, int max_slots)
 {
-    int i;
+    int end = hashdata->migrate_pos + max_slots;
 
-    for (i = 2; i < test / 2; i++) {
-        if (test % i == 0) {
-            i = 1;
-            test++;
+    if (hashdata->old_hash_table == NULL) {
+        return;
+    }
+    if (end > hashdata->old_table_size) {
+        end = hashdata->old_table_size;
+    }
+
+    for (; hashdata->migrate_pos < end; hashdata->migrate_pos++) {
+        if (SLOTHASWORD(hashdata->old_hash_table[hashdata->migrate_pos])) {
+            InsertSlot(hashdata,\
+                &hashdata->old_hash_table[hashdata->migrate_pos]);
         }
     }
 
-    return test;
+    /* Once every old slot has been moved the old table can go */
+    if (hashdata->migrate_pos == hashdata->old_table_size) {
+        free(hashdata->old_hash_table);
+        hashdata->old_hash_table = NULL;
+        hashdata->old_table_size = 0;
+    }
 }
 
-/* Loops to first free each word in the table, the frees the hash table */
-void FreeHashTable(char **hash_table, int table_size)
+/* Clears out every tombstone without a second table. Every word is marked
+ * pending, then each is taken out & reinserted, displacing any still pending
+ * word it meets on the way, which is reinserted in turn */
+void CompactTable(HashData *hashdata)
 {
+    HashSlot *hash_table;
+    HashSlot carried;
+    unsigned char *pending;
     int i;
 
-    for (i = 0; i < table_size; i++) {
-        if (hash_table[i] != NULL) {
-            free(hash_table[i]);
+    FinishResize(hashdata);
+    hash_table = hashdata->hash_table;
+    pending = (unsigned char *)calloc((hashdata->table_size + 7) / 8, 1);
+    if (pending == NULL) {
+        fprintf(stderr, ERR_NO_MEMORY);
+        exit(out_of_memory);
+    }
+
+    for (i = 0; i < hashdata->table_size; i++) {
+        if (SLOTISDELETED(hash_table[i])) {
+            memset(&hash_table[i], EMPTYFILL, sizeof(HashSlot));
+        }
+        else if (!SLOTISEMPTY(hash_table[i])) {
+            pending[i >> 3] |= 1u << (i & 7);
         }
     }
-    free(hash_table);
+    hashdata->deleted_count = 0;
+
+    for (i = 0; i < hashdata->table_size; i++) {
+        if (pending[i >> 3] & (1u << (i & 7))) {
+            carried = hash_table[i];
+            pending[i >> 3] &= ~(1u << (i & 7));
+            memset(&hash_table[i], EMPTYFILL, sizeof(HashSlot));
+            CompactSlot(hashdata, &carried, pending);
+        }
+    }
+
+    free(pending);
 }
 
-double HashSearchTest(HashData *hashdata, char *filename)
+/* Reinserts a slot during CompactTable. A pending slot counts as free, the
+ * slot takes it & the pending word is carried on from its own home slot */
+void CompactSlot(HashData *hashdata, HashSlot *slot, unsigned char *pending)
+{
+    const PrimeStep *step = &PrimeLadder[hashdata->prime_index];
+    HashSlot carried = *slot, resident;
+    int hash2, hash_t;
+
+    hash_t = FastMod(carried.hash1, step->mod_mult, step->prime);
+    hash2 = FastMod(carried.hash2, step->step_mod_mult, step->prime - 1) + 1;
+    carried.dist = 0;
+
+    while (carried.dist < (unsigned int)hashdata->table_size) {
+        if (SLOTISEMPTY(hashdata->hash_table[hash_t])) {
+            hashdata->hash_table[hash_t] = carried;
+            return;
+        }
+
+        if (pending[hash_t >> 3] & (1u << (hash_t & 7))) {
+            pending[hash_t >> 3] &= ~(1u << (hash_t & 7));
+            resident = hashdata->hash_table[hash_t];
+            hashdata->hash_table[hash_t] = carried;
+            carried = resident;
+            hash_t = FastMod(carried.hash1, step->mod_mult, step->prime);
+            hash2 = FastMod(carried.hash2, step->step_mod_mult,\
+                            step->prime - 1) + 1;
+            carried.dist = 0;
+            continue;
+        }
+
+        if (hashdata->robin_hood &&
+            hashdata->hash_table[hash_t].dist < carried.dist) {
+            resident = hashdata->hash_table[hash_t];
+            hashdata->hash_table[hash_t] = carried;
+            carried = resident;
+            hash2 = FastMod(carried.hash2, step->step_mod_mult,\
+                            step->prime - 1) + 1;
+        }
+
+        carried.dist++;
+        hash_t -= hash2;
+        if (hash_t < 0) {
+            hash_t += hashdata->table_size;
+        }
+    }
+
+    fprintf(stderr, ERR_TABLE_FULL);
+    exit(hash_table_full);
+}
+
+/* Removes a word from the table, returning false if it was not there. Its
+ * slot becomes a tombstone, which searches step over & inserts reuse. A
+ * table left mostly empty is shrunk, and one with too many tombstones is
+ * compacted */
+int DeleteWord(HashData *hashdata, char *curr_word)
+{
+    uint64_t full_hash;
+    int pos, prime_index, counter = 0;
+#ifdef INLINE_KEYS
+    unsigned char key[KEYWIDTH];
+
+    PadWord(curr_word, key);
+    curr_word = (char *)key;
+#endif
+
+    /* Migrated slots stay in the old table, finishing leaves one copy */
+    FinishResize(hashdata);
+
+    full_hash = hashdata->hash_family->hash(curr_word, hashdata->hash_seed);
+    pos = TableSearch(hashdata->hash_table, hashdata->prime_index,\
+                      &hashdata->arena, curr_word, (unsigned int)full_hash,\
+                      (unsigned int)(full_hash >> 32), hashdata->robin_hood,\
+                      &counter);
+    if (pos == NOTFOUND) {
+        return false;
+    }
+
+    MARKDELETED(hashdata->hash_table[pos]);
+    hashdata->word_count--;
+    hashdata->deleted_count++;
+
+    /* Shrink to a rung about half as loaded as the maximum, so a few
+     * inserts do not grow it straight back */
+    if (hashdata->word_count < hashdata->max_table_load * SHRINKFRACTION) {
+        prime_index = CapacityIndex(hashdata->word_count * 2L,\
+                                    hashdata->max_load_fraction);
+        if (prime_index < hashdata->prime_index) {
+            RehashTable(hashdata, prime_index);
+            return true;
+        }
+    }
+    if (hashdata->deleted_count >\
+        hashdata->table_size * MAXDELETEDFRACTION) {
+        CompactTable(hashdata);
+    }
+
+    return true;
+}
+
+/* Deletes every word of a file from the table, returning how many were in it */
+int DeleteFileWords(HashData *hashdata, char *filename)
 {
     char curr_word[MAXWORDLEN];
-    int total_lookups = 0;
-    int count = 0;
+    int deleted = 0;
+    FILE *txt_file = fopen(filename, "r");
 
-    FILE *test_file;
-    /* Open test_file file, exit if fopen fails */
-    test_file = fopen(filename, "r");
-    if (test_file == NULL) {
+    if (txt_file == NULL) {
         fprintf(stderr, ERR_FOPEN_FAIL);
         exit(fopen_fail);
     }
 
-    /* Load in the next word and search for it in the hashtable, 
-     * repeat for all words in file */
-    LoadNextWord(curr_word, test_file);
+    LoadNextWord(curr_word, txt_file);
     while (curr_word[0] != '\0') {
-        total_lookups += WordSearch(hashdata, curr_word);
-        count++;
-        LoadNextWord(curr_word, test_file);
+        deleted += DeleteWord(hashdata, curr_word);
+        LoadNextWord(curr_word, txt_file);
     }
 
-    /* Exit if fclose fails */
-    if (fclose(test_file) != 0) {
+    if (fclose(txt_file) != 0) {
         fprintf(stderr, ERR_FCLOSE_FAIL);
         exit(fclose_fail);
     }
+    return deleted;
+}
+
+/* Completes any incremental resize still in progress */
+void FinishResize(HashData *hashdata)
+{
+    if (hashdata->old_hash_table != NULL) {
+        MigrateStep(hashdata,\
+            hashdata->old_table_size - hashdata->migrate_pos);
+    }
+}
+
+/* Grows the table once, straight to a size that holds capacity words
+ * without any further resizes. A table that is already big enough is kept */
+void ReserveCapacity(HashData *hashdata, long capacity)
+{
+    int prime_index = CapacityIndex(capacity, hashdata->max_load_fraction);
+
+    if (prime_index <= hashdata->prime_index) {
+        return;
+    }
+
+    /* An empty table has nothing to move, so is simply replaced */
+    if (hashdata->word_count == 0 && hashdata->old_hash_table == NULL) {
+        free(hashdata->hash_table);
+        NewHashTable(hashdata, prime_index);
+    }
+    else {
+        RehashTable(hashdata, prime_index);
+    }
+}
+
+/* The first ladder rung whose maximum load is at least capacity */
+int CapacityIndex(long capacity, double load_fraction)
+{
+    int i;
+
+    for (i = 0; i < LADDERSTEPS; i++) {
+        if ((long)(PrimeLadder[i].prime * load_fraction) >= capacity) {
+            return i;
+        }
+    }
+
+    fprintf(stderr, ERR_TABLE_MAX);
+    exit(hash_table_full);
+}
+
+/* Counts the lines of a block of text, including a last unterminated one */
+long CountLines(char *text, size_t size)
+{
+    char *pos = text, *end = text + size;
+    long lines = 0;
+
+    while ((pos = memchr(pos, '\n', end - pos)) != NULL) {
+        lines++;
+        pos++;
+    }
+    if (size > 0 && text[size - 1] != '\n') {
+        lines++;
+    }
+    return lines;
+}
+
+/* Counts the lines of a file, reading it in blocks to find the newlines */
+long CountFileLines(char *filename)
+{
+    char block[LINESCANBLOCK];
+    size_t block_len;
+    long lines = 0;
+    int open_line = false;
+    FILE *txt_file = fopen(filename, "r");
+
+    if (txt_file == NULL) {
+        fprintf(stderr, ERR_FOPEN_FAIL);
+        exit(fopen_fail);
+    }
+
+    while ((block_len = fread(block, 1, LINESCANBLOCK, txt_file)) > 0) {
+        /* A line split between blocks is only counted once it ends */
+        lines += CountLines(block, block_len);
+        open_line = block[block_len - 1] != '\n';
+        if (open_line) {
+            lines--;
+        }
+    }
+    if (open_line) {
+        lines++;
+    }
+
+    if (fclose(txt_file) != 0) {
+        fprintf(stderr, ERR_FCLOSE_FAIL);
+        exit(fclose_fail);
+    }
+    return lines;
+}
+
+/* From a given input integer, find the first ladder prime at least as big */
+int PrimeIndex(int size)
+{
+    int i;
+
+    for (i = 0; i < LADDERSTEPS; i++) {
+        if (PrimeLadder[i].prime >= (unsigned int)size) {
+            return i;
+        }
+    }
+
+    fprintf(stderr, ERR_TABLE_MAX);
+    exit(hash_table_full);
+}
+
+/* True if prime_index is a rung of the ladder & its prime is table_size */
+int OnPrimeLadder(int prime_index, int table_size)
+{
+    return prime_index >= 0 && prime_index < LADDERSTEPS &&
+           PrimeLadder[prime_index].prime == (unsigned int)table_size;
+}
+
+/* Seconds on the monotonic clock, for timing the table's phases */
+double WallSeconds(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/* Lemire's fastmod, a % d from the ladder multiplier with no division. The
+ * high half of the 64 x 32 bit product is built from 32 bit halves */
+unsigned int FastMod(unsigned int a, uint64_t mod_mult, unsigned int d)
+{
+    uint64_t low_bits = mod_mult * a;
+
+    return (unsigned int)((((low_bits >> 32) * d) +
+                           (((low_bits & 0xFFFFFFFFu) * d) >> 32)) >> 32);
+}
+
+/* Frees the hash table, then every word at once by freeing the arena. A
+ * mapped snapshot holds both, so is just unmapped */
+void FreeHashTable(HashData *hashdata)
+{
+    free(hashdata->filter.blocks);
+#ifdef TABLE_STATS
+    free(hashdata->stats);
+#endif
+
+    if (hashdata->snapshot != NULL) {
+        munmap(hashdata->snapshot, hashdata->snapshot_size);
+        return;
+    }
+
+    free(hashdata->old_hash_table);
+    free(hashdata->hash_table);
+
+    if (hashdata->arena.mapped) {
+        munmap(hashdata->arena.text, hashdata->arena.used);
+    }
+    else {
+        free(hashdata->arena.text);
+    }
+}
+
+/* The mean, variance & longest of the probe lengths of every stored word,
+ * the lookups each would take to find. Finishes any resize first */
+void ProbeLengthStats(HashData *hashdata, double *mean, double *variance,
+                      int *longest)
+{
+    double sum = 0, sum_squares = 0, length;
+    int i;
+
+    FinishResize(hashdata);
+    *longest = 0;
+    for (i = 0; i < hashdata->table_size; i++) {
+        if (SLOTHASWORD(hashdata->hash_table[i])) {
+            length = hashdata->hash_table[i].dist + 1.0;
+            sum += length;
+            sum_squares += length * length;
+            if (length > *longest) {
+                *longest = (int)length;
+            }
+        }
+    }
+
+    *mean = hashdata->word_count > 0 ? sum / hashdata->word_count : 0;
+    *variance = hashdata->word_count > 0 ?\
+        sum_squares / hashdata->word_count - *mean * *mean : 0;
+}
+
+double HashSearchTest(HashData *hashdata, char *filename)
+{
+    char word_buf[BATCHSIZE][MAXWORDLEN];
+    char *batch[BATCHSIZE];
+    char *mapped_word;
+    int total_lookups = 0;
+    int count = 0;
+    int batch_count = 0;
+    MapFile test_map;
+
+    FILE *test_file;
+
+    if (hashdata->num_threads > 1) {
+        return ParallelSearchTest(hashdata, filename);
+    }
+
+    /* Search for the words where they lie in the mapped test_file */
+    if (MapWordFile(&test_map, filename)) {
+        while ((mapped_word = NextMappedWord(&test_map)) != NULL) {
+            if (hashdata->batch_lookups) {
+                /* Gather words until a whole batch can be looked up */
+                batch[batch_count] = mapped_word;
+                batch_count++;
+                if (batch_count == BATCHSIZE) {
+                    total_lookups +=\
+                        WordSearchBatch(hashdata, batch, batch_count);
+                    batch_count = 0;
+                }
+            }
+            else {
+                total_lookups += WordSearch(hashdata, mapped_word);
+            }
+            count++;
+        }
+        /* Any last, partly filled batch */
+        if (batch_count > 0) {
+            total_lookups += WordSearchBatch(hashdata, batch, batch_count);
+        }
+        UnmapWordFile(&test_map);
+    }
+    else {
+        /* Open test_file file, exit if fopen fails */
+        test_file = fopen(filename, "r");
+        if (test_file == NULL) {
+            fprintf(stderr, ERR_FOPEN_FAIL);
+            exit(fopen_fail);
+        }
+
+        /* Load in the next word and search for it in the hashtable, 
+         * repeat for all words in file. Batched words get a buffer each */
+        LoadNextWord(word_buf[batch_count], test_file);
+        while (word_buf[batch_count][0] != '\0') {
+            if (hashdata->batch_lookups) {
+                batch[batch_count] = word_buf[batch_count];
+                batch_count++;
+                if (batch_count == BATCHSIZE) {
+                    total_lookups +=\
+                        WordSearchBatch(hashdata, batch, batch_count);
+                    batch_count = 0;
+                }
+            }
+            else {
+                total_lookups += WordSearch(hashdata, word_buf[0]);
+            }
+            count++;
+            LoadNextWord(word_buf[batch_count], test_file);
+        }
+        /* Any last, partly filled batch */
+        if (batch_count > 0) {
+            total_lookups += WordSearchBatch(hashdata, batch, batch_count);
+        }
+
+        /* Exit if fclose fails */
+        if (fclose(test_file) != 0) {
+            fprintf(stderr, ERR_FCLOSE_FAIL);
+            exit(fclose_fail);
+        }
+    }
 
     /* Exit if no words were found in test_file */
     if (count == 0) {
@@ -213,34 +1036,245 @@ double HashSearchTest(HashData *hashdata, char *filename)
 
 int WordSearch(HashData *hashdata, char *curr_word) {
 
-    int hash1, hash2, hash_t, counter = 1;
+    int counter;
+
+    /* Pay off part of any resize still in progress */
+    if (hashdata->old_hash_table != NULL) {
+        MigrateStep(hashdata, MIGRATESTEP);
+    }
+
+    counter = FindWord(hashdata, curr_word);
+    if (counter == NOTFOUND) {
+        fprintf(stderr, ERR_WORD_MISSING);
+        exit(word_not_found);
+    }
+
+    return counter;
+}
+
+/* Returns the lookups taken to find the word, or NOTFOUND. The table is only
+ * read, so several threads may search it at once */
+int FindWord(HashData *hashdata, char *curr_word)
+{
+    int counter = 0;
+    uint64_t full_hash;
+    unsigned int full_hash1, full_hash2;
+#ifdef INLINE_KEYS
+    unsigned char key[KEYWIDTH];
+
+    /* Pad the word once, it is still a valid string for hashing */
+    PadWord(curr_word, key);
+    curr_word = (char *)key;
+#endif
+
+    /* Hash the word once for both tables */
+    full_hash = hashdata->hash_family->hash(curr_word, hashdata->hash_seed);
+    full_hash1 = (unsigned int)full_hash;
+    full_hash2 = (unsigned int)(full_hash >> 32);
+
+    /* Most words missing from the table are missing from the filter too */
+    if (hashdata->filter.blocks != NULL &&
+        !FilterMayContain(&hashdata->filter, full_hash)) {
+        STATSCOUNT(hashdata, miss_probes, 0);
+        return NOTFOUND;
+    }
+
+    /* Words not yet migrated are still found in the old table */
+    if (TableSearch(hashdata->hash_table, hashdata->prime_index,\
+                    &hashdata->arena, curr_word, full_hash1, full_hash2,\
+                    hashdata->robin_hood, &counter) != NOTFOUND ||
+        (hashdata->old_hash_table != NULL &&
+         TableSearch(hashdata->old_hash_table, hashdata->old_prime_index,\
+                     &hashdata->arena, curr_word, full_hash1, full_hash2,\
+                     hashdata->robin_hood, &counter) != NOTFOUND)) {
+        STATSCOUNT(hashdata, hit_probes, counter);
+        return counter;
+    }
+
+    STATSCOUNT(hashdata, miss_probes, counter);
+    return NOTFOUND;
+}
+
+/* Probes one table for the word, adding each slot looked at to counter.
+ * Returns the word's slot, or NOTFOUND */
+int TableSearch(HashSlot *hash_table, int prime_index, StrArena *arena,
+                char *curr_word, unsigned int full_hash1,
+                unsigned int full_hash2, int robin_hood, int *counter)
+{
+    const PrimeStep *step = &PrimeLadder[prime_index];
+    int table_size = step->prime;
+    int hash1, hash2, hash_t;
+    unsigned int dist = 0;
+#ifdef INLINE_KEYS
+    (void)arena;
+#endif
 
-    /* Calculate hash1 for the current word */
-    hash1 = HashFunc1(curr_word) % hashdata->table_size;
-    hash2 = (HashFunc2(curr_word) % (hashdata->table_size - 1)) + 1;
+    /* Reduce the word's hashes to this table's size */
+    hash1 = FastMod(full_hash1, step->mod_mult, step->prime);
+    hash2 = FastMod(full_hash2, step->step_mod_mult, step->prime - 1) + 1;
     hash_t = hash1;
 
     do {
-        /* If hasht location is NULL, the word is not in the hash table */
-        if (hashdata->hash_table[hash_t] == NULL) {
-            fprintf(stderr, ERR_WORD_MISSING);
-            exit(word_not_found);
+        (*counter)++;
+
+        /* If hasht location is empty, the word is not in this table */
+        if (SLOTISEMPTY(hash_table[hash_t])) {
+            return NOTFOUND;
+        }
+        /* Nor in a Robin Hood table, if the word would have displaced the
+         * resident here for being further from home */
+        if (robin_hood && hash_table[hash_t].dist < dist) {
+            return NOTFOUND;
         }
 
-        /* If we have found the word return counter value */
-        if (strcmp(hashdata->hash_table[hash_t], curr_word) == 0) {
-            return counter;
+        /* Only a slot with matching hashes can hold the word, so only then
+         * is the word itself compared. An inline key is padded like
+         * curr_word, so is compared whole. Tombstones are stepped over */
+        if (!SLOTISDELETED(hash_table[hash_t]) &&
+            hash_table[hash_t].hash2 == full_hash2 &&
+            hash_table[hash_t].hash1 == full_hash1 &&
+#ifdef INLINE_KEYS
+            KEYSEQUAL(hash_table[hash_t].key, curr_word)) {
+#else
+            strcmp(arena->text + hash_table[hash_t].word, curr_word) == 0) {
+#endif
+            return hash_t;
         }
 
+        dist++;
         hash_t -=hash2;
         /* If  hash_t goes below 0, wrap back past the end of the array */
         if (hash_t < 0) {
-            hash_t += hashdata->table_size;
+            hash_t += table_size;
         }
-        counter++;
     }
     while (hash_t != hash1);
 
     fprintf(stderr, ERR_TABLE_FULL);
     exit(hash_table_full);
-}
\ No newline at end of file
+}
+
+/* Looks up to BATCHSIZE words together, returning their total lookups. All
+ * the hashes are computed and first slots prefetched up front, then the
+ * words are resolved round robin, so while one word's next slot or string
+ * is being fetched the others are being compared */
+int WordSearchBatch(HashData *hashdata, char **words, int num_words)
+{
+    int total_lookups;
+
+    /* The interleaved probes assume a single table, so finish any resize */
+    FinishResize(hashdata);
+
+    total_lookups = FindWordBatch(hashdata, words, num_words);
+    if (total_lookups == NOTFOUND) {
+        fprintf(stderr, ERR_WORD_MISSING);
+        exit(word_not_found);
+    }
+
+    return total_lookups;
+}
+
+/* Returns the total lookups taken to find the batch, or NOTFOUND if any of
+ * its words is missing. Only reads the table, which must not be resizing */
+int FindWordBatch(HashData *hashdata, char **words, int num_words)
+{
+    BatchProbe probes[BATCHSIZE];
+    BatchProbe *probe;
+    HashSlot *slot;
+    uint64_t full_hashes[BATCHSIZE];
+    const PrimeStep *step = &PrimeLadder[hashdata->prime_index];
+    int i, remaining = num_words, total_lookups = 0;
+
+    /* Hash the whole batch together, which may use the vector path */
+    hashdata->hash_family->hash_batch(hashdata->hash_family, words,\
+                                      num_words, hashdata->hash_seed,\
+                                      full_hashes);
+
+    for (i = 0; i < num_words; i++) {
+        probe = &probes[i];
+        probe->word = words[i];
+#ifdef INLINE_KEYS
+        PadWord(words[i], probe->key);
+#endif
+        probe->full_hash1 = (unsigned int)full_hashes[i];
+        probe->full_hash2 = (unsigned int)(full_hashes[i] >> 32);
+        probe->hash1 = FastMod(probe->full_hash1, step->mod_mult, step->prime);
+        probe->hash2 = FastMod(probe->full_hash2, step->step_mod_mult,\
+                               step->prime - 1) + 1;
+        probe->hash_t = probe->hash1;
+        probe->counter = 0;
+        probe->stage = probe_slot;
+        PREFETCH(&hashdata->hash_table[probe->hash_t]);
+    }
+
+    while (remaining > 0) {
+        for (i = 0; i < num_words; i++) {
+            probe = &probes[i];
+            slot = &hashdata->hash_table[probe->hash_t];
+
+            if (probe->stage == probe_slot) {
+                probe->counter++;
+
+                /* If hasht location is empty, the word is not in the table,
+                 * nor if it would have displaced a Robin Hood resident */
+                if (SLOTISEMPTY(*slot) ||
+                    (hashdata->robin_hood &&
+                     slot->dist < (unsigned int)(probe->counter - 1))) {
+                    STATSCOUNT(hashdata, miss_probes, probe->counter);
+                    return NOTFOUND;
+                }
+#ifdef INLINE_KEYS
+                /* The key is in the slot, so is compared straight away */
+                if (!SLOTISDELETED(*slot) &&
+                    slot->hash2 == probe->full_hash2 &&
+                    slot->hash1 == probe->full_hash1 &&
+                    KEYSEQUAL(slot->key, probe->key)) {
+                    total_lookups += probe->counter;
+                    STATSCOUNT(hashdata, hit_probes, probe->counter);
+                    probe->stage = probe_done;
+                    remaining--;
+                    continue;
+                }
+#else
+                /* Matching hashes, fetch the word to compare on the next go */
+                if (!SLOTISDELETED(*slot) &&
+                    slot->hash2 == probe->full_hash2 &&
+                    slot->hash1 == probe->full_hash1) {
+                    PREFETCH(hashdata->arena.text + slot->word);
+                    probe->stage = probe_word;
+                    continue;
+                }
+#endif
+            }
+#ifndef INLINE_KEYS
+            else if (probe->stage == probe_word) {
+                if (strcmp(hashdata->arena.text + slot->word,\
+                           probe->word) == 0) {
+                    total_lookups += probe->counter;
+                    STATSCOUNT(hashdata, hit_probes, probe->counter);
+                    probe->stage = probe_done;
+                    remaining--;
+                    continue;
+                }
+                probe->stage = probe_slot;
+            }
+#endif
+            else {
+                continue;
+            }
+
+            /* Step on to the next slot and start fetching it */
+            probe->hash_t -= probe->hash2;
+            if (probe->hash_t < 0) {
+                probe->hash_t += hashdata->table_size;
+            }
+            if (probe->hash_t == probe->hash1) {
+                fprintf(stderr, ERR_TABLE_FULL);
+                exit(hash_table_full);
+            }
+            PREFETCH(&hashdata->hash_table[probe->hash_t]);
+        }
+    }
+
+    return total_lookups;
+}
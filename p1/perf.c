@@ -0,0 +1,135 @@
+/* syscall() is not declared for strict POSIX builds */
+#define _DEFAULT_SOURCE
+#include "dhash.h"
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+/* The hardware events counted, in the order of PerfEventNames. Cache
+ * events count read misses */
+static const struct PerfEventConfig {
+    unsigned int type;
+    unsigned long config;
+} PerfEvents[PERFEVENTS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+        (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL |
+        (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+        (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}
+};
+#endif
+
+static const char *PerfEventNames[PERFEVENTS] = {
+    "cycles", "instructions", "l1d_misses", "llc_misses", "dtlb_misses",
+    "branch_misses"
+};
+
+/* Opens a counter of this thread's user space time for each event, each
+ * on its own so one the machine lacks leaves the rest working. Events that
+ * cannot be counted, say in a VM, with perf_event_paranoid too high or off
+ * Linux, are left closed & reported as null */
+void PerfOpen(PerfCounters *perf)
+{
+#ifdef __linux__
+    struct perf_event_attr attr;
+#endif
+    int i;
+
+    for (i = 0; i < PERFEVENTS; i++) {
+        perf->fds[i] = -1;
+        perf->counts[i] = -1;
+#ifdef __linux__
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PerfEvents[i].type;
+        attr.config = PerfEvents[i].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        /* Counters sharing the hardware are scaled up by these times */
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+        perf->fds[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1,\
+                                    0);
+#endif
+    }
+}
+
+/* Zeroes & starts every open counter */
+void PerfStart(PerfCounters *perf)
+{
+    int i;
+
+    for (i = 0; i < PERFEVENTS; i++) {
+#ifdef __linux__
+        if (perf->fds[i] >= 0) {
+            ioctl(perf->fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(perf->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+}
+
+/* Stops every open counter & reads its count since PerfStart, or -1 if it
+ * never got onto the hardware */
+void PerfStop(PerfCounters *perf)
+{
+#ifdef __linux__
+    uint64_t values[3];
+#endif
+    int i;
+
+    for (i = 0; i < PERFEVENTS; i++) {
+        perf->counts[i] = -1;
+#ifdef __linux__
+        if (perf->fds[i] < 0) {
+            continue;
+        }
+        ioctl(perf->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        /* The count, then the times enabled & actually counting */
+        if (read(perf->fds[i], values, sizeof(values)) ==\
+                (ssize_t)sizeof(values) && values[2] > 0) {
+            perf->counts[i] = (double)values[0] * values[1] / values[2];
+        }
+#endif
+    }
+}
+
+void PerfClose(PerfCounters *perf)
+{
+    int i;
+
+    for (i = 0; i < PERFEVENTS; i++) {
+        if (perf->fds[i] >= 0) {
+            close(perf->fds[i]);
+            perf->fds[i] = -1;
+        }
+    }
+}
+
+/* Prints the last counts as a named JSON object of events per key, with
+ * null for those that could not be counted */
+void PrintPerfJson(PerfCounters *perf, char *name, double keys)
+{
+    int i;
+
+    printf(", \"%s\": {", name);
+    for (i = 0; i < PERFEVENTS; i++) {
+        printf(i == 0 ? "\"%s\": " : ", \"%s\": ", PerfEventNames[i]);
+        if (perf->counts[i] < 0 || keys <= 0) {
+            printf("null");
+        }
+        else {
+            printf("%.3f", perf->counts[i] / keys);
+        }
+    }
+    putchar('}');
+}
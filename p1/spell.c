@@ -0,0 +1,165 @@
+#include "dhash.h"
+
+/* Odd multipliers choosing the bit a word sets in each word of its block,
+ * those of the split block Bloom filter in Apache Parquet */
+static const unsigned int FilterSalts[FILTERWORDS] = {
+    0x47B6137Bu, 0x44974D91u, 0x8824AD5Bu, 0xA2B7289Du,
+    0x705495C7u, 0x2DF1424Bu, 0x9EFC4947u, 0x5C6BFB31u
+};
+
+/* Looks up every word of the test file, printing each one missing from the
+ * dictionary with its line number rather than stopping, then a summary */
+void SpellCheckTest(HashData *hashdata, char *filename)
+{
+    char word_buf[MAXWORDLEN];
+    char *curr_word;
+    int mapped, count = 0, unknown = 0, filtered = 0;
+    MapFile test_map;
+
+    FILE *test_file = NULL;
+
+    /* Read the words where they lie in the mapped file if possible */
+    mapped = MapWordFile(&test_map, filename);
+    if (!mapped) {
+        test_file = fopen(filename, "r");
+        if (test_file == NULL) {
+            fprintf(stderr, ERR_FOPEN_FAIL);
+            exit(fopen_fail);
+        }
+    }
+
+    for (;;) {
+        if (mapped) {
+            curr_word = NextMappedWord(&test_map);
+        }
+        else {
+            LoadNextWord(word_buf, test_file);
+            curr_word = word_buf[0] != '\0' ? word_buf : NULL;
+        }
+        if (curr_word == NULL) {
+            break;
+        }
+        count++;
+
+        if (FindWord(hashdata, curr_word) == NOTFOUND) {
+            unknown++;
+            if (FilterRejects(hashdata, curr_word)) {
+                filtered++;
+            }
+            printf("line %d: %s\n", count, curr_word);
+        }
+    }
+
+    if (mapped) {
+        UnmapWordFile(&test_map);
+    }
+    else if (fclose(test_file) != 0) {
+        fprintf(stderr, ERR_FCLOSE_FAIL);
+        exit(fclose_fail);
+    }
+
+    /* Exit if no words were found in test_file */
+    if (count == 0) {
+        fprintf(stderr, ERR_EMPTY_FILE);
+        exit(search_file_empty);
+    }
+
+    printf("Checked %d words, %d not in the dictionary, %d of them rejected "
+           "by the filter.\n", count, unknown, filtered);
+}
+
+/* Sizes a filter for the stored words & adds each one's hashes to it,
+ * finishing any resize first. Replaces any earlier filter */
+void BuildWordFilter(HashData *hashdata)
+{
+    BloomFilter *filter = &hashdata->filter;
+    void *blocks;
+    int i;
+
+    FinishResize(hashdata);
+    free(filter->blocks);
+
+    filter->num_blocks = (unsigned int)(((long)hashdata->word_count *\
+        FILTERBITSPERKEY + FILTERWORDS * 32 - 1) / (FILTERWORDS * 32));
+    if (filter->num_blocks == 0) {
+        filter->num_blocks = 1;
+    }
+    /* Blocks are aligned so none straddles two cache lines */
+    if (posix_memalign(&blocks, FILTERALIGN, filter->num_blocks *\
+                       FILTERWORDS * sizeof(unsigned int)) != 0) {
+        fprintf(stderr, ERR_NO_MEMORY);
+        exit(out_of_memory);
+    }
+    STATSBYTES(hashdata, filter->num_blocks * FILTERWORDS *\
+               sizeof(unsigned int));
+    memset(blocks, 0, filter->num_blocks * FILTERWORDS * sizeof(unsigned int));
+    filter->blocks = (unsigned int *)blocks;
+
+    for (i = 0; i < hashdata->table_size; i++) {
+        if (SLOTHASWORD(hashdata->hash_table[i])) {
+            FilterAdd(filter,\
+                      ((uint64_t)hashdata->hash_table[i].hash2 << 32) |\
+                      hashdata->hash_table[i].hash1);
+        }
+    }
+}
+
+/* Mixes a word's table hash with murmur3's 64 bit finaliser, since the
+ * table's own hashes may be too weak to spread words over the filter. The
+ * high half picks the block & the low half a bit in each of its words */
+uint64_t FilterHash(uint64_t key_hash)
+{
+    key_hash ^= key_hash >> 33;
+    key_hash *= UINT64_C(0xFF51AFD7ED558CCD);
+    key_hash ^= key_hash >> 33;
+    key_hash *= UINT64_C(0xC4CEB9FE1A85EC53);
+    key_hash ^= key_hash >> 33;
+    return key_hash;
+}
+
+/* The block a mixed hash picks */
+unsigned int *FilterBlock(BloomFilter *filter, uint64_t filter_hash)
+{
+    return filter->blocks +\
+        ((filter_hash >> 32) * filter->num_blocks >> 32) * FILTERWORDS;
+}
+
+/* Sets a word's bits in its block */
+void FilterAdd(BloomFilter *filter, uint64_t key_hash)
+{
+    uint64_t filter_hash = FilterHash(key_hash);
+    unsigned int *block = FilterBlock(filter, filter_hash);
+    unsigned int bit_hash = (unsigned int)filter_hash;
+    int i;
+
+    for (i = 0; i < FILTERWORDS; i++) {
+        block[i] |= 1u << ((bit_hash * FilterSalts[i]) >> 27);
+    }
+}
+
+/* False only if a word is certainly not in the filter, when one of its bits
+ * in its block is clear. key_hash is the word's table hash */
+int FilterMayContain(BloomFilter *filter, uint64_t key_hash)
+{
+    uint64_t filter_hash = FilterHash(key_hash);
+    unsigned int *block = FilterBlock(filter, filter_hash);
+    unsigned int bit_hash = (unsigned int)filter_hash;
+    unsigned int missing = 0;
+    int i;
+
+    /* Every bit is tested without branching, the whole block is one line */
+    for (i = 0; i < FILTERWORDS; i++) {
+        missing |= ~block[i] & (1u << ((bit_hash * FilterSalts[i]) >> 27));
+    }
+    return missing == 0;
+}
+
+/* Whether the filter alone shows the word is missing from the table */
+int FilterRejects(HashData *hashdata, char *curr_word)
+{
+    if (hashdata->filter.blocks == NULL) {
+        return false;
+    }
+    return !FilterMayContain(&hashdata->filter,\
+        hashdata->hash_family->hash(curr_word, hashdata->hash_seed));
+}
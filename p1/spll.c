@@ -1,28 +1,254 @@
 #include "dhash.h"
 #define STARTSIZE 1000
 
+void ReportHashFamilies(HashData *options, char *dict_name, char *test_name);
+
 int main(int argc, char **argv)
 {
     HashData hashdata;
+    double mean, variance, load_fraction;
+    char *delete_name = NULL, *stats_name = NULL;
+    int i, longest, hash_report = false, bench = false, spell = false,\
+        stream = false;
     InitHashData(&hashdata, STARTSIZE);
 
     /* Exit if not passed a dictionary and word test file */
-    if (argc != 3) {
+    if (argc < 3) {
         fprintf(stderr, ERR_NO_FILE);
         exit(no_file_passed);
     }
 
+    /* Any further arguments switch on optional table modes */
+    for (i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "-incremental") == 0) {
+            hashdata.incremental = true;
+        }
+        else if (strcmp(argv[i], "-batch") == 0) {
+            hashdata.batch_lookups = true;
+        }
+        else if (strcmp(argv[i], "-robinhood") == 0) {
+            hashdata.robin_hood = true;
+        }
+        /* -load F grows the table once F of its slots are full */
+        else if (strcmp(argv[i], "-load") == 0 && i + 1 < argc) {
+            i++;
+            load_fraction = atof(argv[i]);
+            if (load_fraction <= 0 || load_fraction >= 1) {
+                fprintf(stderr, ERR_BAD_LOAD);
+                exit(bad_option);
+            }
+            SetLoadFraction(&hashdata, load_fraction);
+        }
+        /* -threads 0 uses one thread per online core */
+        else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) {
+            i++;
+            hashdata.num_threads = atoi(argv[i]);
+            if (hashdata.num_threads <= 0) {
+                hashdata.num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+            }
+        }
+        else if (strcmp(argv[i], "-hash") == 0 && i + 1 < argc) {
+            i++;
+            hashdata.hash_family = FindHashFamily(argv[i]);
+            if (hashdata.hash_family == NULL) {
+                fprintf(stderr, ERR_BAD_HASH);
+                exit(bad_option);
+            }
+        }
+        else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc) {
+            i++;
+            hashdata.hash_seed = strtoul(argv[i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "-hashreport") == 0) {
+            hash_report = true;
+        }
+        else if (strcmp(argv[i], "-presize") == 0) {
+            hashdata.presize = true;
+        }
+        /* -reserve N sizes the table for N words before loading any */
+        else if (strcmp(argv[i], "-reserve") == 0 && i + 1 < argc) {
+            i++;
+            ReserveCapacity(&hashdata, atol(argv[i]));
+        }
+        /* -delete FILE removes FILE's words once the dictionary is loaded */
+        else if (strcmp(argv[i], "-delete") == 0 && i + 1 < argc) {
+            i++;
+            delete_name = argv[i];
+        }
+        /* -snapshot FILE maps FILE's table if it is up to date, else
+         * builds the table & writes FILE for the next run */
+        else if (strcmp(argv[i], "-snapshot") == 0 && i + 1 < argc) {
+            i++;
+            hashdata.snapshot_name = argv[i];
+        }
+        /* -stats FILE writes the table's statistics to FILE as JSON once
+         * the test has run, or to stdout for "-". Rejected with -bench or
+         * -hashreport, which build tables of their own */
+        else if (strcmp(argv[i], "-stats") == 0 && i + 1 < argc) {
+            i++;
+            stats_name = argv[i];
+        }
+        else if (strcmp(argv[i], "-bench") == 0) {
+            bench = true;
+        }
+        /* -perf adds hardware event counts per key to -bench's output, so
+         * is rejected without -bench */
+        else if (strcmp(argv[i], "-perf") == 0) {
+            hashdata.perf_counters = true;
+        }
+        /* -spell lists the test words missing from the dictionary */
+        else if (strcmp(argv[i], "-spell") == 0) {
+            spell = true;
+            hashdata.use_filter = true;
+        }
+        /* -stream spell checks free form text, or stdin if given "-", over
+         * a pipeline of -threads threads */
+        else if (strcmp(argv[i], "-stream") == 0) {
+            stream = true;
+            hashdata.use_filter = true;
+        }
+        else {
+            fprintf(stderr, ERR_BAD_OPTION);
+            exit(bad_option);
+        }
+    }
+
+    /* The benchmark & hash report never reach the statistics dump */
+    if (stats_name != NULL && (bench || hash_report)) {
+        fprintf(stderr, ERR_BAD_OPTION);
+        exit(bad_option);
+    }
+
+    /* The counters only run around the benchmark's build & search */
+    if (hashdata.perf_counters && !bench) {
+        fprintf(stderr, ERR_BAD_OPTION);
+        exit(bad_option);
+    }
+
+    /* Compare every hash family instead of running the normal test */
+    if (hash_report) {
+        ReportHashFamilies(&hashdata, argv[1], argv[2]);
+        FreeHashTable(&hashdata);
+        return 0;
+    }
+
+    /* Print machine readable timings instead of the normal test */
+    if (bench) {
+        RunBenchmark(&hashdata, argv[1], argv[2]);
+        FreeHashTable(&hashdata);
+        return 0;
+    }
+
+    /* A mapped snapshot is read only, so is not used if deleting words */
+    if (delete_name != NULL) {
+        hashdata.snapshot_name = NULL;
+    }
+
     /* Set up the hash table for the given dictionary file */
     CreateHashTable(&hashdata, argv[1]);
 
+    if (delete_name != NULL) {
+        printf("Deleted %d words.", DeleteFileWords(&hashdata, delete_name));
+        putchar(spell || stream ? '\n' : ' ');
+    }
+
+    /* Report every unknown word of the text instead of the normal test */
+    if (stream) {
+        StreamSpellCheck(&hashdata, argv[2]);
+        if (stats_name != NULL) {
+            DumpTableStats(&hashdata, stats_name);
+        }
+        FreeHashTable(&hashdata);
+        return 0;
+    }
+
+    /* Report every unknown word instead of the normal test */
+    if (spell) {
+        SpellCheckTest(&hashdata, argv[2]);
+        if (stats_name != NULL) {
+            DumpTableStats(&hashdata, stats_name);
+        }
+        FreeHashTable(&hashdata);
+        return 0;
+    }
+
     /* Search for the test words in the hash table */
     printf("Table size = %d. ", hashdata.table_size);
     printf("The words took an average of %f lookups to find.\n",\
             HashSearchTest(&hashdata, argv[2])
     );
+
+    /* Spread of the lookups every dictionary word would take */
+    ProbeLengthStats(&hashdata, &mean, &variance, &longest);
+    printf("Stored words probe length mean %f, variance %f, longest %d.\n",\
+           mean, variance, longest);
+
+    if (stats_name != NULL) {
+        DumpTableStats(&hashdata, stats_name);
+    }
     
     /* Free up all dynamically allocated space using in the hash table */
-    FreeHashTable(hashdata.hash_table, hashdata.table_size);
+    FreeHashTable(&hashdata);
 
     return 0;
-}
\ No newline at end of file
+}
+
+/* Builds the table with each hash family in turn, reporting its average
+ * lookups and the time taken to hash the test words, one at a time and
+ * through the family's batch path */
+void ReportHashFamilies(HashData *options, char *dict_name, char *test_name)
+{
+    HashData hashdata;
+    WordList word_list;
+    const HashFamily *family;
+    uint64_t hashes[BATCHSIZE];
+    volatile uint64_t sink = 0;
+    double start, average, scalar_ns, batch_ns;
+    int i, j, batch_count;
+
+    LoadWordList(&word_list, test_name);
+    if (word_list.count == 0) {
+        fprintf(stderr, ERR_EMPTY_FILE);
+        exit(search_file_empty);
+    }
+
+    for (family = HashFamilies; family->name != NULL; family++) {
+        /* Build & search a fresh table with the same modes as options */
+        InitHashData(&hashdata, STARTSIZE);
+        hashdata.hash_family = family;
+        hashdata.hash_seed = options->hash_seed;
+        hashdata.incremental = options->incremental;
+        hashdata.robin_hood = options->robin_hood;
+        SetLoadFraction(&hashdata, options->max_load_fraction);
+        hashdata.presize = options->presize;
+        hashdata.batch_lookups = options->batch_lookups;
+        hashdata.num_threads = options->num_threads;
+        CreateHashTable(&hashdata, dict_name);
+        average = HashSearchTest(&hashdata, test_name);
+        FreeHashTable(&hashdata);
+
+        start = WallSeconds();
+        for (i = 0; i < word_list.count; i++) {
+            sink ^= family->hash(word_list.words[i], options->hash_seed);
+        }
+        scalar_ns = (WallSeconds() - start) * 1e9 / word_list.count;
+
+        start = WallSeconds();
+        for (i = 0; i < word_list.count; i += batch_count) {
+            batch_count = word_list.count - i < BATCHSIZE ?\
+                word_list.count - i : BATCHSIZE;
+            family->hash_batch(family, word_list.words + i, batch_count,\
+                               options->hash_seed, hashes);
+            for (j = 0; j < batch_count; j++) {
+                sink ^= hashes[j];
+            }
+        }
+        batch_ns = (WallSeconds() - start) * 1e9 / word_list.count;
+
+        printf("%-8s average lookups %f, hashing %.2f ns/key, "
+               "%.2f ns/key batched\n",
+               family->name, average, scalar_ns, batch_ns);
+    }
+
+    FreeWordList(&word_list);
+}
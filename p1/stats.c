@@ -0,0 +1,122 @@
+#include "dhash.h"
+
+/* Writes the table's statistics as one JSON object to the file, or stdout
+ * for "-". The cluster sizes & memory use are read off the table as it is
+ * now, the probe length histograms need a build with -DTABLE_STATS */
+void DumpTableStats(HashData *hashdata, char *filename)
+{
+    unsigned long clusters[STATSCLUSTERS];
+    unsigned long bytes_in_use;
+    FILE *stats_file;
+
+    ClusterSizes(hashdata, clusters);
+    bytes_in_use = (unsigned long)hashdata->table_size * sizeof(HashSlot) +\
+        (unsigned long)hashdata->old_table_size * sizeof(HashSlot) +\
+        hashdata->arena.size +\
+        hashdata->filter.num_blocks * FILTERWORDS * sizeof(unsigned int);
+
+    if (strcmp(filename, "-") == 0) {
+        stats_file = stdout;
+    }
+    else {
+        stats_file = fopen(filename, "w");
+        if (stats_file == NULL) {
+            fprintf(stderr, ERR_FOPEN_FAIL);
+            exit(fopen_fail);
+        }
+    }
+
+    fprintf(stats_file, "{\"engine\": \"%s\", \"hash\": \"%s\", "
+            "\"words\": %d, \"table_size\": %d, \"resizes\": %d, "
+            "\"resize_seconds\": %f, \"bytes_in_use\": %lu",
+            ENGINENAME, hashdata->hash_family->name, hashdata->word_count,
+            hashdata->table_size, hashdata->resize_count,
+            hashdata->resize_seconds, bytes_in_use);
+#ifdef TABLE_STATS
+    fprintf(stats_file, ", \"bytes_allocated\": %lu",\
+            hashdata->stats->bytes_allocated);
+    PrintHistogram(stats_file, "insert_probes",\
+                   hashdata->stats->insert_probes, STATSPROBES);
+    PrintHistogram(stats_file, "hit_probes", hashdata->stats->hit_probes,\
+                   STATSPROBES);
+    PrintHistogram(stats_file, "miss_probes", hashdata->stats->miss_probes,\
+                   STATSPROBES);
+#endif
+    PrintHistogram(stats_file, "cluster_sizes", clusters, STATSCLUSTERS);
+    fprintf(stats_file, "}\n");
+
+    if (stats_file != stdout && fclose(stats_file) != 0) {
+        fprintf(stderr, ERR_FCLOSE_FAIL);
+        exit(fclose_fail);
+    }
+}
+
+/* Counts the runs of filled slots, words or tombstones, by size. Entry k is
+ * the runs of 2^k up to 2^(k+1) - 1 slots, the last also every longer run.
+ * A run may wrap from the end of the table to its start. Finishes any
+ * resize first */
+void ClusterSizes(HashData *hashdata, unsigned long *clusters)
+{
+    int i, pos, start = 0, run = 0, bucket;
+
+    FinishResize(hashdata);
+    memset(clusters, 0, STATSCLUSTERS * sizeof(unsigned long));
+
+    /* Start just after an empty slot so no run is split by the wrap */
+    for (i = 0; i < hashdata->table_size; i++) {
+        if (SLOTISEMPTY(hashdata->hash_table[i])) {
+            start = i + 1;
+            break;
+        }
+    }
+
+    for (i = 0; i <= hashdata->table_size; i++) {
+        pos = (start + i) % hashdata->table_size;
+        if (i < hashdata->table_size &&
+            !SLOTISEMPTY(hashdata->hash_table[pos])) {
+            run++;
+            continue;
+        }
+        if (run > 0) {
+            bucket = 0;
+            while (bucket < STATSCLUSTERS - 1 && run >> (bucket + 1) != 0) {
+                bucket++;
+            }
+            clusters[bucket]++;
+            run = 0;
+        }
+    }
+}
+
+/* Prints a histogram as a named JSON array, dropping the empty buckets
+ * after the last filled one */
+void PrintHistogram(FILE *stats_file, char *name, unsigned long *counts,
+                    int num_counts)
+{
+    int i;
+
+    while (num_counts > 0 && counts[num_counts - 1] == 0) {
+        num_counts--;
+    }
+
+    fprintf(stats_file, ", \"%s\": [", name);
+    for (i = 0; i < num_counts; i++) {
+        fprintf(stats_file, i == 0 ? "%lu" : ", %lu", counts[i]);
+    }
+    fprintf(stats_file, "]");
+}
+
+#ifdef TABLE_STATS
+/* Adds one thread's counts into the table's */
+void MergeTableStats(TableStats *total, TableStats *stats)
+{
+    int i;
+
+    for (i = 0; i < STATSPROBES; i++) {
+        total->insert_probes[i] += stats->insert_probes[i];
+        total->hit_probes[i] += stats->hit_probes[i];
+        total->miss_probes[i] += stats->miss_probes[i];
+    }
+    total->bytes_allocated += stats->bytes_allocated;
+}
+#endif
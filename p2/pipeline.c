@@ -0,0 +1,540 @@
+#include "shash.h"
+#include <pthread.h>
+#include <sched.h>
+
+/* Compilers without the builtins share one lock for every atomic access,
+ * slower but still correct */
+#ifndef __GNUC__
+static pthread_mutex_t AtomicLock = PTHREAD_MUTEX_INITIALIZER;
+
+unsigned long AtomicLoad(volatile unsigned long *ptr)
+{
+    unsigned long value;
+
+    pthread_mutex_lock(&AtomicLock);
+    value = *ptr;
+    pthread_mutex_unlock(&AtomicLock);
+    return value;
+}
+
+void AtomicStore(volatile unsigned long *ptr, unsigned long value)
+{
+    pthread_mutex_lock(&AtomicLock);
+    *ptr = value;
+    pthread_mutex_unlock(&AtomicLock);
+}
+
+int AtomicSwapIf(volatile unsigned long *ptr, unsigned long *expected,
+                 unsigned long desired)
+{
+    int swapped;
+
+    pthread_mutex_lock(&AtomicLock);
+    swapped = *ptr == *expected;
+    if (swapped) {
+        *ptr = desired;
+    }
+    else {
+        *expected = *ptr;
+    }
+    pthread_mutex_unlock(&AtomicLock);
+    return swapped;
+}
+#endif
+
+/* Marks the end of a stage's input, never filled with text */
+static TextBlock StopBlock;
+
+#ifdef TABLE_STATS
+/* Held by a lookup thread adding its counts to the table's */
+static pthread_mutex_t StatsLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* Spell checks free form text as it streams in from a file, or stdin for
+ * "-". The main thread reads the text in blocks cut at line ends, which
+ * tokenizer threads split into words, lookup threads check against the
+ * shared table & a writer thread reports in input order. The stages pass a
+ * fixed pool of blocks through bounded lock-free queues, so memory stays
+ * flat however long the text is. Returns the unknown words found */
+long StreamSpellCheck(HashData *hashdata, char *filename)
+{
+    Pipeline pipeline;
+    pthread_t tokenizers[MAXTHREADS], lookups[MAXTHREADS], writer;
+    TextBlock *blocks;
+    FILE *text_file;
+    int i, num_tokenizers, num_lookups, num_blocks;
+
+    /* Half the threads tokenize & half look words up, at least one each */
+    num_tokenizers = hashdata->num_threads / 2;
+    if (num_tokenizers < 1) {
+        num_tokenizers = 1;
+    }
+    if (num_tokenizers > MAXTHREADS) {
+        num_tokenizers = MAXTHREADS;
+    }
+    num_lookups = hashdata->num_threads - num_tokenizers;
+    if (num_lookups < 1) {
+        num_lookups = 1;
+    }
+    if (num_lookups > MAXTHREADS) {
+        num_lookups = MAXTHREADS;
+    }
+    num_blocks = 2 * (num_tokenizers + num_lookups) + 2;
+
+    if (strcmp(filename, "-") == 0) {
+        text_file = stdin;
+    }
+    else {
+        text_file = fopen(filename, "rb");
+        if (text_file == NULL) {
+            fprintf(stderr, ERR_FOPEN_FAIL);
+            exit(fopen_fail);
+        }
+    }
+
+    /* Every queue can hold the whole pool, so a push never waits */
+    pipeline.hashdata = hashdata;
+    pipeline.num_blocks = num_blocks;
+    NewBlockQueue(&pipeline.free_blocks, num_blocks);
+    NewBlockQueue(&pipeline.to_tokenize, num_blocks + MAXTHREADS);
+    NewBlockQueue(&pipeline.to_lookup, num_blocks + MAXTHREADS);
+    NewBlockQueue(&pipeline.to_write, num_blocks + 1);
+    pipeline.word_count = 0;
+    pipeline.line_count = 0;
+    pipeline.unknown_count = 0;
+
+    blocks = (TextBlock *)calloc(num_blocks, sizeof(TextBlock));
+    if (blocks == NULL) {
+        fprintf(stderr, ERR_NO_MEMORY);
+        exit(out_of_memory);
+    }
+    for (i = 0; i < num_blocks; i++) {
+        /* One spare byte terminates a word ending the block */
+        blocks[i].text = malloc(TEXTBLOCKSIZE + 1);
+        if (blocks[i].text == NULL) {
+            fprintf(stderr, ERR_NO_MEMORY);
+            exit(out_of_memory);
+        }
+        QueuePush(&pipeline.free_blocks, &blocks[i]);
+    }
+
+    for (i = 0; i < num_tokenizers; i++) {
+        if (pthread_create(&tokenizers[i], NULL, TokenizerMain,\
+                           &pipeline) != 0) {
+            fprintf(stderr, ERR_THREAD_FAIL);
+            exit(thread_fail);
+        }
+    }
+    for (i = 0; i < num_lookups; i++) {
+        if (pthread_create(&lookups[i], NULL, LookupMain, &pipeline) != 0) {
+            fprintf(stderr, ERR_THREAD_FAIL);
+            exit(thread_fail);
+        }
+    }
+    if (pthread_create(&writer, NULL, WriterMain, &pipeline) != 0) {
+        fprintf(stderr, ERR_THREAD_FAIL);
+        exit(thread_fail);
+    }
+
+    ReadTextBlocks(&pipeline, text_file);
+
+    /* Each stage is stopped once the one before it has drained into it */
+    for (i = 0; i < num_tokenizers; i++) {
+        QueuePush(&pipeline.to_tokenize, &StopBlock);
+    }
+    for (i = 0; i < num_tokenizers; i++) {
+        pthread_join(tokenizers[i], NULL);
+    }
+    for (i = 0; i < num_lookups; i++) {
+        QueuePush(&pipeline.to_lookup, &StopBlock);
+    }
+    for (i = 0; i < num_lookups; i++) {
+        pthread_join(lookups[i], NULL);
+    }
+    QueuePush(&pipeline.to_write, &StopBlock);
+    pthread_join(writer, NULL);
+
+    if (text_file != stdin && fclose(text_file) != 0) {
+        fprintf(stderr, ERR_FCLOSE_FAIL);
+        exit(fclose_fail);
+    }
+
+    printf("Checked %ld words on %ld lines, %ld not in the dictionary.\n",\
+           pipeline.word_count, pipeline.line_count, pipeline.unknown_count);
+
+    for (i = 0; i < num_blocks; i++) {
+        free(blocks[i].text);
+        free(blocks[i].tokens);
+    }
+    free(blocks);
+    free(pipeline.free_blocks.cells);
+    free(pipeline.to_tokenize.cells);
+    free(pipeline.to_lookup.cells);
+    free(pipeline.to_write.cells);
+
+    return pipeline.unknown_count;
+}
+
+/* The reader stage, run by the calling thread. Fills free blocks with the
+ * text, each cut after its last newline so lines are not split, & hands
+ * them on numbered in order. The rest of a cut block starts the next one */
+void ReadTextBlocks(Pipeline *pipeline, FILE *text_file)
+{
+    TextBlock *block;
+    char *carry;
+    size_t len, cut, carry_len = 0;
+    unsigned long seq = 0;
+    long column = 0;
+    int at_end = false;
+
+    carry = malloc(TEXTBLOCKSIZE);
+    if (carry == NULL) {
+        fprintf(stderr, ERR_NO_MEMORY);
+        exit(out_of_memory);
+    }
+
+    while (!at_end) {
+        block = QueuePop(&pipeline->free_blocks);
+        memcpy(block->text, carry, carry_len);
+        len = carry_len + fread(block->text + carry_len, 1,\
+                                TEXTBLOCKSIZE - carry_len, text_file);
+        if (ferror(text_file)) {
+            fprintf(stderr, ERR_READ_FAIL);
+            exit(read_fail);
+        }
+        at_end = len < TEXTBLOCKSIZE;
+        if (len == 0) {
+            QueuePush(&pipeline->free_blocks, block);
+            break;
+        }
+
+        /* Cut after the last newline, or with none in a full block after
+         * the last non letter, so no word is split either way */
+        cut = len;
+        if (!at_end) {
+            while (cut > 0 && block->text[cut - 1] != '\n') {
+                cut--;
+            }
+            if (cut == 0) {
+                cut = len;
+                while (cut > 0 &&
+                       isalpha((unsigned char)block->text[cut - 1]) != 0) {
+                    cut--;
+                }
+                if (cut == 0) {
+                    cut = len;
+                }
+            }
+        }
+        carry_len = len - cut;
+        memcpy(carry, block->text + cut, carry_len);
+
+        block->len = cut;
+        block->seq = seq;
+        block->start_column = column;
+        block->ends_line = block->text[cut - 1] == '\n';
+        seq++;
+        /* A block cut mid line leaves the next one starting part way in */
+        column = block->ends_line ? 0 : column + (long)cut;
+
+        QueuePush(&pipeline->to_tokenize, block);
+    }
+
+    free(carry);
+}
+
+/* Tokenizer stage thread. Splits each block into its runs of letters, each
+ * terminated in place & recorded with its line within the block & column */
+void *TokenizerMain(void *pipeline_data)
+{
+    Pipeline *pipeline = (Pipeline *)pipeline_data;
+    TextBlock *block;
+    char *text;
+    size_t i, start, line_start;
+    unsigned int line;
+
+    while ((block = QueuePop(&pipeline->to_tokenize)) != &StopBlock) {
+        text = block->text;
+        block->token_count = 0;
+        line = 0;
+        line_start = 0;
+
+        i = 0;
+        while (i < block->len) {
+            if (isalpha((unsigned char)text[i]) == 0) {
+                if (text[i] == '\n') {
+                    line++;
+                    line_start = i + 1;
+                }
+                i++;
+                continue;
+            }
+
+            start = i;
+            while (i < block->len && isalpha((unsigned char)text[i]) != 0) {
+                i++;
+            }
+            AddToken(block, start, i - start, line, (long)(start -\
+                     line_start) + 1 + (line == 0 ? block->start_column : 0));
+
+            /* The character after the word is counted before it becomes
+             * the word's terminator */
+            if (i < block->len && text[i] == '\n') {
+                line++;
+                line_start = i + 1;
+            }
+            text[i] = '\0';
+            i++;
+        }
+        block->line_count = line;
+
+        QueuePush(&pipeline->to_lookup, block);
+    }
+
+    return NULL;
+}
+
+/* Appends a word to the block's tokens, growing them as needed. The token
+ * array is kept with the block & reused */
+void AddToken(TextBlock *block, size_t offset, size_t len, unsigned int line,
+              long column)
+{
+    Token *tokens;
+
+    if (block->token_count == block->token_size) {
+        block->token_size = block->token_size == 0 ?\
+            TOKENSTARTSIZE : block->token_size * 2;
+        tokens = (Token *)realloc(block->tokens,\
+                                  block->token_size * sizeof(Token));
+        if (tokens == NULL) {
+            fprintf(stderr, ERR_NO_MEMORY);
+            exit(out_of_memory);
+        }
+        block->tokens = tokens;
+    }
+    block->tokens[block->token_count].offset = (unsigned int)offset;
+    block->tokens[block->token_count].len = (unsigned int)len;
+    block->tokens[block->token_count].line = line;
+    block->tokens[block->token_count].column = column;
+    block->token_count++;
+}
+
+/* Lookup stage thread. Checks every word of each block against the shared
+ * table, which is only read as FindWord never reorders chains, & moves the
+ * unknown ones to the front of the block's tokens */
+void *LookupMain(void *pipeline_data)
+{
+    Pipeline *pipeline = (Pipeline *)pipeline_data;
+    HashData *hashdata = pipeline->hashdata;
+    TextBlock *block;
+    int i;
+#ifdef TABLE_STATS
+    HashData view = *hashdata;
+    TableStats stats;
+
+    /* Look up through a copy of the table's data counting into stats */
+    memset(&stats, 0, sizeof(TableStats));
+    view.stats = &stats;
+    hashdata = &view;
+#endif
+
+    while ((block = QueuePop(&pipeline->to_lookup)) != &StopBlock) {
+        block->unknown_count = 0;
+        for (i = 0; i < block->token_count; i++) {
+            if (!KnownWord(hashdata,\
+                           block->text + block->tokens[i].offset,\
+                           block->tokens[i].len)) {
+                block->tokens[block->unknown_count] = block->tokens[i];
+                block->unknown_count++;
+            }
+        }
+        QueuePush(&pipeline->to_write, block);
+    }
+
+#ifdef TABLE_STATS
+    pthread_mutex_lock(&StatsLock);
+    MergeTableStats(pipeline->hashdata->stats, &stats);
+    pthread_mutex_unlock(&StatsLock);
+#endif
+    return NULL;
+}
+
+/* Whether a word of text is in the dictionary as written, or failing that
+ * in lower case, so capitalised words at the start of a sentence are found.
+ * Words too long for the table never are */
+int KnownWord(HashData *hashdata, char *word, unsigned int len)
+{
+    char lower[MAXWORDLEN];
+    unsigned int i;
+    int has_upper = false;
+
+    if (len >= MAXWORDLEN) {
+        return false;
+    }
+    if (FindWord(hashdata, word) != NOTFOUND) {
+        return true;
+    }
+
+    for (i = 0; i <= len; i++) {
+        lower[i] = (char)tolower((unsigned char)word[i]);
+        if (lower[i] != word[i]) {
+            has_upper = true;
+        }
+    }
+    return has_upper && FindWord(hashdata, lower) != NOTFOUND;
+}
+
+/* Writer stage thread. Blocks finish out of order, so each is held until
+ * every block before it has been written, then its unknown words are
+ * printed with their line & column in the whole text & the block freed */
+void *WriterMain(void *pipeline_data)
+{
+    Pipeline *pipeline = (Pipeline *)pipeline_data;
+    TextBlock **pending;
+    TextBlock *block;
+    Token *token;
+    unsigned long next_seq = 0;
+    long line_base = 1;
+    int i, slot;
+
+    /* No more than num_blocks are in flight, so their slots never clash */
+    pending = (TextBlock **)calloc(pipeline->num_blocks, sizeof(TextBlock *));
+    if (pending == NULL) {
+        fprintf(stderr, ERR_NO_MEMORY);
+        exit(out_of_memory);
+    }
+
+    while ((block = QueuePop(&pipeline->to_write)) != &StopBlock) {
+        pending[block->seq % pipeline->num_blocks] = block;
+
+        slot = next_seq % pipeline->num_blocks;
+        while (pending[slot] != NULL && pending[slot]->seq == next_seq) {
+            block = pending[slot];
+            pending[slot] = NULL;
+
+            for (i = 0; i < block->unknown_count; i++) {
+                token = &block->tokens[i];
+                printf("line %ld, column %ld: %s\n", line_base + token->line,\
+                       token->column, block->text + token->offset);
+            }
+            pipeline->word_count += block->token_count;
+            pipeline->unknown_count += block->unknown_count;
+            /* A last line with no newline still counts as a line */
+            pipeline->line_count = line_base + block->line_count -\
+                (block->ends_line ? 1 : 0);
+            line_base += block->line_count;
+
+            QueuePush(&pipeline->free_blocks, block);
+            next_seq++;
+            slot = next_seq % pipeline->num_blocks;
+        }
+    }
+
+    free(pending);
+    return NULL;
+}
+
+/* Allocates an empty queue with room for at least capacity blocks */
+void NewBlockQueue(BlockQueue *queue, int capacity)
+{
+    unsigned long i, size = 2;
+
+    while (size < (unsigned long)capacity) {
+        size *= 2;
+    }
+    queue->cells = (QueueCell *)malloc(size * sizeof(QueueCell));
+    if (queue->cells == NULL) {
+        fprintf(stderr, ERR_NO_MEMORY);
+        exit(out_of_memory);
+    }
+    /* Each cell's sequence is the push position that may next fill it */
+    for (i = 0; i < size; i++) {
+        queue->cells[i].seq = i;
+        queue->cells[i].block = NULL;
+    }
+    queue->mask = size - 1;
+    queue->head = 0;
+    queue->tail = 0;
+}
+
+/* Adds a block to a bounded multi producer, multi consumer queue without
+ * locking. A producer claims the tail position by compare & swap, then
+ * publishes the block by advancing its cell's sequence. Returns false if
+ * the queue is full */
+int QueueTryPush(BlockQueue *queue, TextBlock *block)
+{
+    QueueCell *cell;
+    unsigned long pos = ATOMICLOAD(&queue->tail), seq;
+    long diff;
+
+    for (;;) {
+        cell = &queue->cells[pos & queue->mask];
+        seq = ATOMICLOAD(&cell->seq);
+        diff = (long)(seq - pos);
+        if (diff == 0) {
+            if (ATOMICSWAPIF(&queue->tail, &pos, pos + 1)) {
+                break;
+            }
+        }
+        else if (diff < 0) {
+            return false;
+        }
+        else {
+            pos = ATOMICLOAD(&queue->tail);
+        }
+    }
+
+    cell->block = block;
+    ATOMICSTORE(&cell->seq, pos + 1);
+    return true;
+}
+
+/* Takes the oldest block from a queue, or NULL if it is empty. The cell is
+ * handed back to producers a lap of the queue later */
+TextBlock *QueueTryPop(BlockQueue *queue)
+{
+    QueueCell *cell;
+    TextBlock *block;
+    unsigned long pos = ATOMICLOAD(&queue->head), seq;
+    long diff;
+
+    for (;;) {
+        cell = &queue->cells[pos & queue->mask];
+        seq = ATOMICLOAD(&cell->seq);
+        diff = (long)(seq - (pos + 1));
+        if (diff == 0) {
+            if (ATOMICSWAPIF(&queue->head, &pos, pos + 1)) {
+                break;
+            }
+        }
+        else if (diff < 0) {
+            return NULL;
+        }
+        else {
+            pos = ATOMICLOAD(&queue->head);
+        }
+    }
+
+    block = cell->block;
+    ATOMICSTORE(&cell->seq, pos + queue->mask + 1);
+    return block;
+}
+
+/* Pushes a block, yielding the core while the queue is full */
+void QueuePush(BlockQueue *queue, TextBlock *block)
+{
+    while (!QueueTryPush(queue, block)) {
+        sched_yield();
+    }
+}
+
+/* Pops a block, yielding the core while the queue is empty */
+TextBlock *QueuePop(BlockQueue *queue)
+{
+    TextBlock *block;
+
+    while ((block = QueueTryPop(queue)) == NULL) {
+        sched_yield();
+    }
+    return block;
+}
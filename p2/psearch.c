@@ -0,0 +1,192 @@
+#include "shash.h"
+#include <pthread.h>
+
+/* Gathers every word of the test file, then gives each thread an equal
+ * chunk to search for in the shared table. The table is only read while the
+ * workers run, and each keeps its own lookup total until they are merged */
+double ParallelSearchTest(HashData *hashdata, char *filename)
+{
+    WordList word_list;
+    SearchWorker workers[MAXTHREADS];
+    pthread_t threads[MAXTHREADS];
+    int i, chunk, start, num_threads = hashdata->num_threads;
+    int missing = false;
+    double total_lookups = 0.0;
+
+    LoadWordList(&word_list, filename);
+
+    /* Exit if no words were found in test_file */
+    if (word_list.count == 0) {
+        fprintf(stderr, ERR_EMPTY_FILE);
+        exit(search_file_empty);
+    }
+
+    if (num_threads > MAXTHREADS) {
+        num_threads = MAXTHREADS;
+    }
+    chunk = (word_list.count + num_threads - 1) / num_threads;
+
+    for (i = 0; i < num_threads; i++) {
+        start = i * chunk < word_list.count ? i * chunk : word_list.count;
+        workers[i].hashdata = hashdata;
+        workers[i].words = word_list.words + start;
+        workers[i].num_words = word_list.count - start < chunk ?\
+            word_list.count - start : chunk;
+
+        if (pthread_create(&threads[i], NULL, SearchWorkerMain,\
+                           &workers[i]) != 0) {
+            fprintf(stderr, ERR_THREAD_FAIL);
+            exit(thread_fail);
+        }
+    }
+
+    /* Merge the per thread totals once every worker has finished */
+    for (i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+        total_lookups += workers[i].total_lookups;
+#ifdef TABLE_STATS
+        MergeTableStats(hashdata->stats, &workers[i].stats);
+#endif
+        if (workers[i].status == word_not_found) {
+            missing = true;
+        }
+    }
+    FreeWordList(&word_list);
+
+    /* A worker reports a missing word, only the main thread exits for it */
+    if (missing) {
+        fprintf(stderr, ERR_WORD_MISSING);
+        exit(word_not_found);
+    }
+
+    return total_lookups / word_list.count;
+}
+
+/* Reads every word of the file into the list, in the same way and with the
+ * same checks as HashSearchTest */
+void LoadWordList(WordList *word_list, char *filename)
+{
+    char *mapped_word;
+    int i, size = BATCHSIZE;
+    FILE *test_file;
+
+    word_list->count = 0;
+    word_list->buf = NULL;
+    word_list->words = malloc(size * sizeof(char *));
+    if (word_list->words == NULL) {
+        fprintf(stderr, ERR_NO_MEMORY);
+        exit(out_of_memory);
+    }
+
+    /* The words can be used where they lie in the mapped test_file */
+    if (MapWordFile(&word_list->map, filename)) {
+        while ((mapped_word = NextMappedWord(&word_list->map)) != NULL) {
+            if (word_list->count == size) {
+                size *= 2;
+                word_list->words =\
+                    realloc(word_list->words, size * sizeof(char *));
+                if (word_list->words == NULL) {
+                    fprintf(stderr, ERR_NO_MEMORY);
+                    exit(out_of_memory);
+                }
+            }
+            word_list->words[word_list->count] = mapped_word;
+            word_list->count++;
+        }
+        return;
+    }
+    word_list->map.text = NULL;
+
+    /* Open test_file file, exit if fopen fails */
+    test_file = fopen(filename, "r");
+    if (test_file == NULL) {
+        fprintf(stderr, ERR_FOPEN_FAIL);
+        exit(fopen_fail);
+    }
+
+    /* Otherwise each word is copied into its own MAXWORDLEN record */
+    word_list->buf = malloc(size * MAXWORDLEN);
+    if (word_list->buf == NULL) {
+        fprintf(stderr, ERR_NO_MEMORY);
+        exit(out_of_memory);
+    }
+    LoadNextWord(word_list->buf, test_file);
+    while (word_list->buf[word_list->count * MAXWORDLEN] != '\0') {
+        word_list->count++;
+        if (word_list->count == size) {
+            size *= 2;
+            word_list->buf = realloc(word_list->buf, size * MAXWORDLEN);
+            if (word_list->buf == NULL) {
+                fprintf(stderr, ERR_NO_MEMORY);
+                exit(out_of_memory);
+            }
+        }
+        LoadNextWord(word_list->buf + word_list->count * MAXWORDLEN,\
+                     test_file);
+    }
+
+    /* Exit if fclose fails */
+    if (fclose(test_file) != 0) {
+        fprintf(stderr, ERR_FCLOSE_FAIL);
+        exit(fclose_fail);
+    }
+
+    /* Only point at the records once buf has stopped moving */
+    word_list->words = realloc(word_list->words, size * sizeof(char *));
+    if (word_list->words == NULL) {
+        fprintf(stderr, ERR_NO_MEMORY);
+        exit(out_of_memory);
+    }
+    for (i = 0; i < word_list->count; i++) {
+        word_list->words[i] = word_list->buf + i * MAXWORDLEN;
+    }
+}
+
+void FreeWordList(WordList *word_list)
+{
+    if (word_list->map.text != NULL) {
+        UnmapWordFile(&word_list->map);
+    }
+    free(word_list->buf);
+    free(word_list->words);
+}
+
+/* Searches for one chunk of words. A missing word sets the worker's status
+ * rather than exiting, which is left to the main thread */
+void *SearchWorkerMain(void *worker_data)
+{
+    SearchWorker *worker = (SearchWorker *)worker_data;
+    int i, batch_count, lookups;
+#ifdef TABLE_STATS
+    HashData view = *worker->hashdata;
+
+    /* Search through a copy of the table's data counting into the worker */
+    memset(&worker->stats, 0, sizeof(TableStats));
+    view.stats = &worker->stats;
+    worker->hashdata = &view;
+#endif
+
+    worker->total_lookups = 0.0;
+    worker->status = 0;
+
+    for (i = 0; i < worker->num_words; i += batch_count) {
+        if (worker->hashdata->batch_lookups) {
+            batch_count = worker->num_words - i < BATCHSIZE ?\
+                worker->num_words - i : BATCHSIZE;
+            lookups = FindWordBatch(worker->hashdata, worker->words + i,\
+                                    batch_count);
+        }
+        else {
+            batch_count = 1;
+            lookups = FindWord(worker->hashdata, worker->words[i]);
+        }
+
+        if (lookups == NOTFOUND) {
+            worker->status = word_not_found;
+            return NULL;
+        }
+        worker->total_lookups += lookups;
+    }
+
+    return NULL;
+}
@@ -1,22 +1,185 @@
 #include "shash.h"
 
 #define PRIME 31
+#define LADDERSTEPS (int)(sizeof(PrimeLadder) / sizeof(PrimeLadder[0]))
+
+/* Each prime is the next prime >= twice the one before it, so growing the
+ * table steps up one rung instead of searching for primes at runtime.
+ * Multipliers are 2^64 / prime + 1 */
+static const PrimeStep PrimeLadder[] = {
+    {         5, UINT64_C(0x3333333333333334)},
+    {        11, UINT64_C(0x1745D1745D1745D2)},
+    {        23, UINT64_C(0x0B21642C8590B217)},
+    {        53, UINT64_C(0x04D4873ECADE304E)},
+    {       113, UINT64_C(0x0243F6F0243F6F03)},
+    {       251, UINT64_C(0x0105197F7D734042)},
+    {       503, UINT64_C(0x00824A4E60B3262C)},
+    {      1009, UINT64_C(0x0040F391612C6681)},
+    {      2027, UINT64_C(0x002054DEC8CF1FB4)},
+    {      4057, UINT64_C(0x0010275FF9F13C03)},
+    {      8117, UINT64_C(0x000812EC59F2D11B)},
+    {     16249, UINT64_C(0x00040881F21AB04C)},
+    {     32503, UINT64_C(0x0002042CA46C6871)},
+    {     65011, UINT64_C(0x000102113D5AD344)},
+    {    130027, UINT64_C(0x0000810759802C1B)},
+    {    260081, UINT64_C(0x00004081F5D2FFD7)},
+    {    520193, UINT64_C(0x000020407CF1D40A)},
+    {   1040387, UINT64_C(0x000010203D74DE37)},
+    {   2080777, UINT64_C(0x000008101DF76660)},
+    {   4161557, UINT64_C(0x000004080ECAF108)},
+    {   8323151, UINT64_C(0x0000020406CF2211)},
+    {  16646317, UINT64_C(0x0000010203585467)},
+    {  33292687, UINT64_C(0x00000081019EB4A7)},
+    {  66585377, UINT64_C(0x0000004080CF2992)},
+    { 133170769, UINT64_C(0x00000020406757D7)},
+    { 266341583, UINT64_C(0x0000001020337E36)},
+    { 532683227, UINT64_C(0x000000081019AF9D)},
+    {1065366479, UINT64_C(0x00000004080CD639)},
+    {2130732959, UINT64_C(0x0000000204066B19)},
+};
 
 void InitialiseHashData(HashData *hashdata, int size)
 {
-    int prime_size = PrimeReturn(size);
+#ifdef TABLE_STATS
+    hashdata->stats = (TableStats *)calloc(1, sizeof(TableStats));
+    if (hashdata->stats == NULL) {
+        fprintf(stderr, ERR_NO_MEMORY);
+        exit(out_of_memory);
+    }
+#endif
+
+    /* Start with an empty string arena & element pool, both bump allocated */
+    hashdata->arena.text = malloc(ARENASTARTSIZE);
+    hashdata->pool.elems = malloc(POOLSTARTSIZE * sizeof(HashElem));
+    if (hashdata->arena.text == NULL || hashdata->pool.elems == NULL) {
+        fprintf(stderr, ERR_NO_MEMORY);
+        exit(out_of_memory);
+    }
+    STATSBYTES(hashdata, ARENASTARTSIZE + POOLSTARTSIZE * sizeof(HashElem));
+    hashdata->arena.used = 0;
+    hashdata->arena.size = ARENASTARTSIZE;
+    hashdata->arena.mapped = false;
+    hashdata->pool.used = 0;
+    hashdata->pool.size = POOLSTARTSIZE;
+    hashdata->hash_family = &HashFamilies[0];
+    hashdata->hash_seed = DEFAULTSEED;
+    hashdata->word_count = 0;
+    hashdata->resize_count = 0;
+    hashdata->resize_seconds = 0;
+    hashdata->presize = false;
+    hashdata->snapshot_name = NULL;
+    hashdata->snapshot = NULL;
+    hashdata->snapshot_size = 0;
+    hashdata->use_filter = false;
+    hashdata->filter.blocks = NULL;
+    hashdata->filter.num_blocks = 0;
+    hashdata->check_duplicates = false;
+    hashdata->reorder = reorder_none;
+    hashdata->batch_lookups = false;
+    hashdata->num_threads = 1;
+    hashdata->perf_counters = false;
+
+    NewHashTable(hashdata, PrimeIndex(size));
+}
 
-    hashdata->hash_table = (HashElem **)calloc(prime_size, sizeof(HashElem *));
+/* Allocates an empty table of the ladder size, leaving the words alone */
+void NewHashTable(HashData *hashdata, int prime_index)
+{
+    int prime_size = PrimeLadder[prime_index].prime;
+
+    hashdata->hash_table =\
+        (unsigned int *)malloc(prime_size * sizeof(unsigned int));
+    if (hashdata->hash_table == NULL) {
+        fprintf(stderr, ERR_NO_MEMORY);
+        exit(out_of_memory);
+    }
+    STATSBYTES(hashdata, prime_size * sizeof(unsigned int));
+    /* Every byte 0xFF makes every bucket ENDOFCHAIN, an empty chain */
+    memset(hashdata->hash_table, 0xFF, prime_size * sizeof(unsigned int));
+    hashdata->prime_index = prime_index;
     hashdata->table_size = prime_size;
     hashdata->max_table_load = (int)(prime_size * MAXLOADFRACTION);
 }
 
+/* Builds the table from the dictionary file, or with a snapshot file set,
+ * maps the snapshot in if it is up to date & otherwise builds then saves it.
+ * Only an empty table is replaced by a snapshot. The word filter, if used,
+ * is built from the finished table */
 void CreateHashTable(HashData *hashdata, char *filename)
 {
-    int count = 0;
+    SnapHeader identity;
+
+    if (hashdata->snapshot_name == NULL || hashdata->word_count != 0 ||
+        !SnapshotIdentity(hashdata, filename, &identity)) {
+        BuildHashTable(hashdata, filename);
+    }
+    else if (!LoadSnapshot(hashdata, &identity)) {
+        BuildHashTable(hashdata, filename);
+        SaveSnapshot(hashdata, &identity);
+    }
+
+    if (hashdata->use_filter) {
+        BuildWordFilter(hashdata);
+    }
+}
+
+/* Adds every word of the dictionary file to the table */
+void BuildHashTable(HashData *hashdata, char *filename)
+{
     char curr_word[MAXWORDLEN];
+    char *mapped_word;
+    MapFile dict_map;
 
     FILE *dict_file;
+
+    /* Map an empty table's dictionary in & use it as the arena, so words
+     * are hashed where they lie in the file rather than being copied */
+    if (hashdata->arena.used == 0 && MapWordFile(&dict_map, filename)) {
+        /* Every line is at most one word, so one resize makes room for all */
+        if (hashdata->presize) {
+            ReserveCapacity(hashdata, hashdata->word_count +\
+                            CountLines(dict_map.text, dict_map.size));
+        }
+        free(hashdata->arena.text);
+        hashdata->arena.text = dict_map.text;
+        hashdata->arena.used = (unsigned int)dict_map.size;
+        hashdata->arena.size = (unsigned int)dict_map.size;
+        hashdata->arena.mapped = true;
+
+        while ((mapped_word = NextMappedWord(&dict_map)) != NULL) {
+            if (InsertElement(hashdata,\
+                    (unsigned int)(mapped_word - hashdata->arena.text),\
+                    (unsigned int)hashdata->hash_family->hash(mapped_word,\
+                        hashdata->hash_seed))) {
+                hashdata->word_count++;
+            }
+
+            /* If the hash table is too full, rebuild the table 2x size */
+            if (hashdata->word_count > hashdata->max_table_load) {
+                ResizeHashTable(hashdata);
+            }
+        }
+#ifdef INLINE_KEYS
+        /* Every key was copied into its element, so the mapping can go */
+        munmap(hashdata->arena.text, hashdata->arena.used);
+        hashdata->arena.text = malloc(ARENASTARTSIZE);
+        if (hashdata->arena.text == NULL) {
+            fprintf(stderr, ERR_NO_MEMORY);
+            exit(out_of_memory);
+        }
+        STATSBYTES(hashdata, ARENASTARTSIZE);
+        hashdata->arena.used = 0;
+        hashdata->arena.size = ARENASTARTSIZE;
+        hashdata->arena.mapped = false;
+#endif
+        return;
+    }
+
+    if (hashdata->presize) {
+        ReserveCapacity(hashdata,\
+                        hashdata->word_count + CountFileLines(filename));
+    }
+
     /* Open dictionary file, exit if fopen fails */
     dict_file = fopen(filename, "r");
     if (dict_file == NULL) {
@@ -27,11 +190,12 @@ void CreateHashTable(HashData *hashdata, char *filename)
     /* Load in next word & add it to the hash table, repeat for all words */
     LoadNextWord(curr_word, dict_file);
     while (curr_word[0] != '\0') {
-        AddToHashTable(hashdata, curr_word);
-        count++;
+        if (AddToHashTable(hashdata, curr_word)) {
+            hashdata->word_count++;
+        }
 
         /* If the hash table is too full, rebuild the table 2x size */
-        if (count > hashdata->max_table_load) {
+        if (hashdata->word_count > hashdata->max_table_load) {
             ResizeHashTable(hashdata);
         }
         LoadNextWord(curr_word, dict_file);
@@ -63,32 +227,239 @@ void LoadNextWord(char *curr_word, FILE *txt_file)
     curr_word[counter] = '\0';
 }
 
-/* Finds a hash for the current word, then places it in the hash table */
-void AddToHashTable(HashData *hashdata, char *curr_word)
+/* Maps a word file into memory, returning false if the caller should fall
+ * back to reading it with LoadNextWord instead */
+int MapWordFile(MapFile *map_file, char *filename)
+{
+    struct stat file_stat;
+    int fd = open(filename, O_RDONLY);
+
+    /* Exit if the file cannot be opened, the same as a failed fopen */
+    if (fd < 0) {
+        fprintf(stderr, ERR_FOPEN_FAIL);
+        exit(fopen_fail);
+    }
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0 ||
+        (unsigned long)file_stat.st_size >= ENDOFCHAIN) {
+        close(fd);
+        return false;
+    }
+    map_file->size = (size_t)file_stat.st_size;
+    map_file->pos = 0;
+
+    /* Private writable pages let words be terminated in place, the file on
+     * disk is never modified */
+    map_file->text = mmap(NULL, map_file->size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map_file->text == MAP_FAILED) {
+        map_file->text = NULL;
+        return false;
+    }
+
+    /* With no final newline the last word is terminated in the page's spare
+     * tail, which does not exist if the file fills its last page exactly */
+    if (map_file->text[map_file->size - 1] != '\n' &&
+        map_file->size % sysconf(_SC_PAGESIZE) == 0) {
+        UnmapWordFile(map_file);
+        return false;
+    }
+    posix_madvise(map_file->text, map_file->size, POSIX_MADV_SEQUENTIAL);
+
+    return true;
+}
+
+/* Returns the next word of the mapped file, or NULL at the end. Non alpha
+ * characters are squeezed out in place and the newline becomes the '\0' */
+char *NextMappedWord(MapFile *map_file)
 {
-    int hash = HashFunc(curr_word) % hashdata->table_size;
-    HashElem *new_element;
-    HashElem *prev_pointer;
-    HashElem *temp_pointer = hashdata->hash_table[hash];
+    char *curr_word = map_file->text + map_file->pos;
+    char *line_end;
+    int counter = 0;
+    size_t i, line_len;
 
-    /* Initialise the new element with the current word */
-    new_element = calloc(1, sizeof(HashElem));
-    new_element->word = calloc(strlen(curr_word) + 1, sizeof(char));
-    strcpy(new_element->word, curr_word);
+    if (map_file->pos >= map_file->size) {
+        return NULL;
+    }
 
-    /* Point the hashtable location at the newly created element */
-    if (hashdata->hash_table[hash] == NULL) {
-        hashdata->hash_table[hash] = new_element;
+    /* Find the whole line in one pass, rather than a char at a time */
+    line_end = memchr(curr_word, '\n', map_file->size - map_file->pos);
+    if (line_end == NULL) {
+        line_len = map_file->size - map_file->pos;
+        map_file->pos = map_file->size;
     }
-    /* If the location is taken, follow the list to find a free space */
     else {
-        do {
-            prev_pointer = temp_pointer;
-            temp_pointer = temp_pointer->next;
+        line_len = line_end - curr_word;
+        map_file->pos += line_len + 1;
+    }
+
+    for (i = 0; i < line_len; i++) {
+        if (isalpha((unsigned char)curr_word[i]) != 0) {
+            curr_word[counter] = curr_word[i];
+            counter++;
+
+            if (counter > MAXWORDLEN - 1) {
+                fprintf(stderr, ERR_LONG_STR);
+                exit(str_too_long);
+            }
         }
-        while (temp_pointer != NULL);
-        prev_pointer->next = new_element;
     }
+    curr_word[counter] = '\0';
+
+    /* An empty line ends the word list, the same as LoadNextWord */
+    if (counter == 0) {
+        map_file->pos = map_file->size;
+        return NULL;
+    }
+
+    return curr_word;
+}
+
+void UnmapWordFile(MapFile *map_file)
+{
+    munmap(map_file->text, map_file->size);
+    map_file->text = NULL;
+    map_file->size = 0;
+}
+
+/* Copies the current word into the arena, then places it in the hash table.
+ * Returns false, giving the arena space back, if it was a duplicate */
+int AddToHashTable(HashData *hashdata, char *curr_word)
+{
+    unsigned int offset = ArenaAddWord(hashdata, curr_word);
+
+    if (!InsertElement(hashdata, offset,\
+            (unsigned int)hashdata->hash_family->hash(curr_word,\
+                                                      hashdata->hash_seed))) {
+        hashdata->arena.used = offset;
+        return false;
+    }
+#ifdef INLINE_KEYS
+    /* The key was copied into its element, so the arena space is free */
+    hashdata->arena.used = offset;
+#endif
+    return true;
+}
+
+/* Places an arena word at the head of its chain, using its full hash.
+ * Returns false without inserting if duplicates are checked for & the word
+ * is already in the chain */
+int InsertElement(HashData *hashdata, unsigned int word,
+                  unsigned int full_hash)
+{
+    int hash = FastMod(full_hash,\
+                       PrimeLadder[hashdata->prime_index].mod_mult,\
+                       hashdata->table_size);
+    HashElem *elems = hashdata->pool.elems;
+    char *text = hashdata->arena.text;
+    char *curr_word = text + word;
+    unsigned int elem, new_index;
+    int probes = 1;
+#ifdef INLINE_KEYS
+    unsigned char key[KEYWIDTH];
+
+    PadWord(curr_word, key);
+    curr_word = (char *)key;
+#endif
+
+    if (hashdata->check_duplicates) {
+        for (elem = hashdata->hash_table[hash]; elem != ENDOFCHAIN;
+             elem = elems[elem].next) {
+            if (elems[elem].hash == full_hash &&
+                ELEMMATCHES(elems[elem], text, curr_word)) {
+                return false;
+            }
+            probes++;
+        }
+    }
+    /* The new head, & any elements checked for a duplicate */
+    STATSCOUNT(hashdata, insert_probes, probes);
+
+    /* The pool may move as it grows, so only index it afterwards */
+    new_index = PoolAddElement(hashdata);
+    elems = hashdata->pool.elems;
+#ifdef INLINE_KEYS
+    memcpy(elems[new_index].key, key, KEYWIDTH);
+#else
+    elems[new_index].word = word;
+#endif
+    elems[new_index].hash = full_hash;
+    elems[new_index].next = hashdata->hash_table[hash];
+    hashdata->hash_table[hash] = new_index;
+
+    if (hashdata->filter.blocks != NULL) {
+        FilterAdd(&hashdata->filter, full_hash);
+    }
+    return true;
+}
+
+/* Takes the next free element from the pool, returning its index */
+unsigned int PoolAddElement(HashData *hashdata)
+{
+    ElemPool *pool = &hashdata->pool;
+
+    /* Double the pool when full, indices stay valid across the realloc */
+    if (pool->used == pool->size) {
+        if (pool->size > ENDOFCHAIN / 2) {
+            fprintf(stderr, ERR_NO_MEMORY);
+            exit(out_of_memory);
+        }
+        pool->size *= 2;
+        pool->elems = realloc(pool->elems, pool->size * sizeof(HashElem));
+        if (pool->elems == NULL) {
+            fprintf(stderr, ERR_NO_MEMORY);
+            exit(out_of_memory);
+        }
+        STATSBYTES(hashdata, pool->size * sizeof(HashElem));
+    }
+
+    return pool->used++;
+}
+
+/* Copies a word to the end of the arena, returning its offset */
+unsigned int ArenaAddWord(HashData *hashdata, char *curr_word)
+{
+    StrArena *arena = &hashdata->arena;
+    unsigned int len = (unsigned int)strlen(curr_word) + 1;
+    unsigned int offset = arena->used;
+
+    /* Double the arena when full, offsets stay valid across the realloc */
+    if (arena->used + len > arena->size) {
+        if (arena->size > ENDOFCHAIN / 2) {
+            fprintf(stderr, ERR_NO_MEMORY);
+            exit(out_of_memory);
+        }
+        arena->size *= 2;
+        arena->text = ArenaGrow(arena);
+        if (arena->text == NULL) {
+            fprintf(stderr, ERR_NO_MEMORY);
+            exit(out_of_memory);
+        }
+        STATSBYTES(hashdata, arena->size);
+    }
+    memcpy(arena->text + offset, curr_word, len);
+    arena->used += len;
+
+    return offset;
+}
+
+/* Reallocates the arena text at its new size. A mapped dictionary is copied
+ * onto the heap first, keeping every offset into it valid */
+char *ArenaGrow(StrArena *arena)
+{
+    char *heap_text;
+
+    if (!arena->mapped) {
+        return realloc(arena->text, arena->size);
+    }
+
+    heap_text = malloc(arena->size);
+    if (heap_text != NULL) {
+        memcpy(heap_text, arena->text, arena->used);
+        munmap(arena->text, arena->used);
+        arena->mapped = false;
+    }
+    return heap_text;
 }
 
 /* Calculates a hash using each char & string length */
@@ -105,93 +476,279 @@ unsigned int HashFunc(char *str)
     return hash;
 }
 
-/* Creates a new larger hash table, moves the old values into the new table */
+/* The original hash as a family, in the low half of the 64 bit value.
+ * Unseeded */
+uint64_t HashClassic(char *str, uint64_t seed)
+{
+    (void)seed;
+    return HashFunc(str);
+}
+
+/* Seconds on the monotonic clock, for timing the table's phases */
+double WallSeconds(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/* Creates a new larger hash table on the next rung of the ladder */
 void ResizeHashTable(HashData *hashdata)
 {
-    HashElem **old_hash_table = hashdata->hash_table;
-    HashElem *temp_pointer;
-    int i, old_table_size = hashdata->table_size;
+    RehashTable(hashdata, hashdata->prime_index + 1);
+}
 
-    /* Create the new bigger hash table, currently empty */
-    InitialiseHashData(hashdata, hashdata->table_size * SIZEINCREASE);
+/* Creates a new hash table on the given rung & relinks every element of
+ * the pool into it. Nothing is allocated but the new buckets, elements &
+ * words stay where they are */
+void RehashTable(HashData *hashdata, int prime_index)
+{
+    HashElem *elems = hashdata->pool.elems;
+    const PrimeStep *step;
+    unsigned int elem, hash;
+    double start = WallSeconds();
+
+    if (prime_index >= LADDERSTEPS) {
+        fprintf(stderr, ERR_TABLE_MAX);
+        exit(hash_table_full);
+    }
+    /* Chains are rebuilt from the pool alone, so the old buckets can go
+     * before the new ones are allocated */
+    free(hashdata->hash_table);
+    NewHashTable(hashdata, prime_index);
+    step = &PrimeLadder[prime_index];
+
+    /* Pushing the pool onto the chain heads in order leaves each chain
+     * newest first, the same as inserting its words one by one */
+    for (elem = 0; elem < hashdata->pool.used; elem++) {
+        hash = FastMod(elems[elem].hash, step->mod_mult, step->prime);
+        elems[elem].next = hashdata->hash_table[hash];
+        hashdata->hash_table[hash] = elem;
+    }
 
-    for (i = 0; i < old_table_size; i++) {
-        /* For each element in the old table, add to the new table & free it */
-        temp_pointer = old_hash_table[i];
-        while (temp_pointer != NULL) {
-            AddToHashTable(hashdata, temp_pointer->word);
-            temp_pointer = temp_pointer->next;
-        }
+    hashdata->resize_count++;
+    hashdata->resize_seconds += WallSeconds() - start;
+}
+
+/* Grows the table once, straight to a size that holds capacity words
+ * without any further resizes. A table that is already big enough is kept */
+void ReserveCapacity(HashData *hashdata, long capacity)
+{
+    int prime_index = CapacityIndex(capacity);
 
+    if (prime_index <= hashdata->prime_index) {
+        return;
+    }
+
+    /* An empty table has nothing to move, so is simply replaced */
+    if (hashdata->word_count == 0) {
+        free(hashdata->hash_table);
+        NewHashTable(hashdata, prime_index);
+    }
+    else {
+        RehashTable(hashdata, prime_index);
     }
-    FreeHashTable(old_hash_table, old_table_size);
 }
 
-/* For a given input integer, return the next highest prime number */
-int PrimeReturn(int test)
+/* The first ladder rung whose maximum load is at least capacity */
+int CapacityIndex(long capacity)
 {
     int i;
 
-    for (i = 2; i < test / 2; i++) {
-        if (test % i == 0) {
-            i = 1;
-            test++;
+    for (i = 0; i < LADDERSTEPS; i++) {
+        if ((long)(PrimeLadder[i].prime * MAXLOADFRACTION) >= capacity) {
+            return i;
         }
     }
-    return test;
+
+    fprintf(stderr, ERR_TABLE_MAX);
+    exit(hash_table_full);
 }
 
-/* Loops to first free each word in the table, the frees the hash table */
-void FreeHashTable(HashElem **hash_table, int table_size)
+/* Counts the lines of a block of text, including a last unterminated one */
+long CountLines(char *text, size_t size)
 {
-    int i;
-    HashElem *temp_pointer;
-    HashElem *next_pointer;
+    char *pos = text, *end = text + size;
+    long lines = 0;
 
-    for (i = 0; i < table_size; i++) {
-        /* If the hash location has a chain, free elements in the chain */
-        if (hash_table[i] != NULL) {
-            next_pointer = hash_table[i];
+    while ((pos = memchr(pos, '\n', end - pos)) != NULL) {
+        lines++;
+        pos++;
+    }
+    if (size > 0 && text[size - 1] != '\n') {
+        lines++;
+    }
+    return lines;
+}
 
-            do {
-                temp_pointer = next_pointer;
-                next_pointer = next_pointer->next;
+/* Counts the lines of a file, reading it in blocks to find the newlines */
+long CountFileLines(char *filename)
+{
+    char block[LINESCANBLOCK];
+    size_t block_len;
+    long lines = 0;
+    int open_line = false;
+    FILE *txt_file = fopen(filename, "r");
 
-                free(temp_pointer->word);
-                free(temp_pointer);
-            }
-            while (next_pointer != NULL);
+    if (txt_file == NULL) {
+        fprintf(stderr, ERR_FOPEN_FAIL);
+        exit(fopen_fail);
+    }
+
+    while ((block_len = fread(block, 1, LINESCANBLOCK, txt_file)) > 0) {
+        /* A line split between blocks is only counted once it ends */
+        lines += CountLines(block, block_len);
+        open_line = block[block_len - 1] != '\n';
+        if (open_line) {
+            lines--;
+        }
+    }
+    if (open_line) {
+        lines++;
+    }
+
+    if (fclose(txt_file) != 0) {
+        fprintf(stderr, ERR_FCLOSE_FAIL);
+        exit(fclose_fail);
+    }
+    return lines;
+}
+
+/* For a given input integer, return the first ladder prime at least as big */
+int PrimeIndex(int size)
+{
+    int i;
+
+    for (i = 0; i < LADDERSTEPS; i++) {
+        if (PrimeLadder[i].prime >= (unsigned int)size) {
+            return i;
         }
     }
-    free(hash_table);
+
+    fprintf(stderr, ERR_TABLE_MAX);
+    exit(hash_table_full);
+}
+
+/* True if prime_index is a rung of the ladder & its prime is table_size */
+int OnPrimeLadder(int prime_index, int table_size)
+{
+    return prime_index >= 0 && prime_index < LADDERSTEPS &&
+           PrimeLadder[prime_index].prime == (unsigned int)table_size;
+}
+
+/* Lemire's fastmod, a % d from the ladder multiplier with no division. The
+ * high half of the 64 x 32 bit product is built from 32 bit halves */
+unsigned int FastMod(unsigned int a, uint64_t mod_mult, unsigned int d)
+{
+    uint64_t low_bits = mod_mult * a;
+
+    return (unsigned int)((((low_bits >> 32) * d) +
+                           (((low_bits & 0xFFFFFFFFu) * d) >> 32)) >> 32);
+}
+
+/* Frees the table, the element pool & the arena, unmapping a mapped one. A
+ * mapped snapshot holds all three, so is just unmapped */
+void FreeHashTable(HashData *hashdata)
+{
+    free(hashdata->filter.blocks);
+#ifdef TABLE_STATS
+    free(hashdata->stats);
+#endif
+
+    if (hashdata->snapshot != NULL) {
+        munmap(hashdata->snapshot, hashdata->snapshot_size);
+        return;
+    }
+
+    free(hashdata->hash_table);
+    free(hashdata->pool.elems);
+
+    if (hashdata->arena.mapped) {
+        munmap(hashdata->arena.text, hashdata->arena.used);
+    }
+    else {
+        free(hashdata->arena.text);
+    }
 }
 
 double HashSearchTest(HashData *hashdata, char *filename)
 {
-    char curr_word[MAXWORDLEN];
+    char word_buf[BATCHSIZE][MAXWORDLEN];
+    char *batch[BATCHSIZE];
+    char *mapped_word;
     int total_lookups = 0;
     int count = 0;
+    int batch_count = 0;
+    MapFile test_map;
 
     FILE *test_file;
-    /* Open test_file file, exit if fopen fails */
-    test_file = fopen(filename, "r");
-    if (test_file == NULL) {
-        fprintf(stderr, ERR_FOPEN_FAIL);
-        exit(fopen_fail);
+
+    if (hashdata->num_threads > 1) {
+        return ParallelSearchTest(hashdata, filename);
     }
 
-    /* Load word and search for it in the hashtable, repeat for all words */
-    LoadNextWord(curr_word, test_file);
-    while (curr_word[0] != '\0') {
-        total_lookups += WordSearch(hashdata, curr_word);
-        count++;
-        LoadNextWord(curr_word, test_file);
+    /* Search for the words where they lie in the mapped test_file */
+    if (MapWordFile(&test_map, filename)) {
+        while ((mapped_word = NextMappedWord(&test_map)) != NULL) {
+            if (hashdata->batch_lookups) {
+                /* Gather words until a whole batch can be looked up */
+                batch[batch_count] = mapped_word;
+                batch_count++;
+                if (batch_count == BATCHSIZE) {
+                    total_lookups +=\
+                        WordSearchBatch(hashdata, batch, batch_count);
+                    batch_count = 0;
+                }
+            }
+            else {
+                total_lookups += WordSearch(hashdata, mapped_word);
+            }
+            count++;
+        }
+        /* Any last, partly filled batch */
+        if (batch_count > 0) {
+            total_lookups += WordSearchBatch(hashdata, batch, batch_count);
+        }
+        UnmapWordFile(&test_map);
     }
+    else {
+        /* Open test_file file, exit if fopen fails */
+        test_file = fopen(filename, "r");
+        if (test_file == NULL) {
+            fprintf(stderr, ERR_FOPEN_FAIL);
+            exit(fopen_fail);
+        }
 
-    /* Exit if fclose fails */
-    if (fclose(test_file) != 0) {
-        fprintf(stderr, ERR_FCLOSE_FAIL);
-        exit(fclose_fail);
+        /* Load word and search for it in the hashtable, repeat for all.
+         * Batched words get a buffer each */
+        LoadNextWord(word_buf[batch_count], test_file);
+        while (word_buf[batch_count][0] != '\0') {
+            if (hashdata->batch_lookups) {
+                batch[batch_count] = word_buf[batch_count];
+                batch_count++;
+                if (batch_count == BATCHSIZE) {
+                    total_lookups +=\
+                        WordSearchBatch(hashdata, batch, batch_count);
+                    batch_count = 0;
+                }
+            }
+            else {
+                total_lookups += WordSearch(hashdata, word_buf[0]);
+            }
+            count++;
+            LoadNextWord(word_buf[batch_count], test_file);
+        }
+        /* Any last, partly filled batch */
+        if (batch_count > 0) {
+            total_lookups += WordSearchBatch(hashdata, batch, batch_count);
+        }
+
+        /* Exit if fclose fails */
+        if (fclose(test_file) != 0) {
+            fprintf(stderr, ERR_FCLOSE_FAIL);
+            exit(fclose_fail);
+        }
     }
 
     /* Exit if no words were found in test_file */
@@ -205,32 +762,250 @@ double HashSearchTest(HashData *hashdata, char *filename)
 
 int WordSearch(HashData *hashdata, char *curr_word) {
 
-    int hash, counter = 1;
-    HashElem *temp_pointer;
+    int counter;
 
-    /* Calculate hash for the current word */
-    hash = HashFunc(curr_word) % hashdata->table_size;
+    if (hashdata->reorder == reorder_none) {
+        counter = FindWord(hashdata, curr_word);
+    }
+    else {
+        counter = FindWordReorder(hashdata, curr_word);
+    }
 
-    /* If hash location is NULL, the word is not in the hash table */
-    if (hashdata->hash_table[hash] == NULL) {
+    if (counter == NOTFOUND) {
         fprintf(stderr, ERR_WORD_MISSING);
         exit(word_not_found);
     }
-    /* If we have found the word return counter value */
-    if (strcmp(hashdata->hash_table[hash]->word, curr_word) == 0) {
+
+    return counter;
+}
+
+/* Returns the lookups taken to find the word, or NOTFOUND. The table is only
+ * read, so several threads may search it at once */
+int FindWord(HashData *hashdata, char *curr_word)
+{
+    int hash, counter = 1;
+    unsigned int full_hash, elem;
+    HashElem *elems = hashdata->pool.elems;
+    char *text = hashdata->arena.text;
+#ifdef INLINE_KEYS
+    unsigned char key[KEYWIDTH];
+
+    /* Pad the word once, it is still a valid string for hashing */
+    PadWord(curr_word, key);
+    curr_word = (char *)key;
+#endif
+
+    /* Calculate hash for the current word */
+    full_hash = (unsigned int)hashdata->hash_family->hash(curr_word,\
+                                                         hashdata->hash_seed);
+
+    /* Most words missing from the table are missing from the filter too */
+    if (hashdata->filter.blocks != NULL &&
+        !FilterMayContain(&hashdata->filter, full_hash)) {
+        STATSCOUNT(hashdata, miss_probes, 0);
+        return NOTFOUND;
+    }
+
+    hash = FastMod(full_hash,\
+                   PrimeLadder[hashdata->prime_index].mod_mult,\
+                   hashdata->table_size);
+
+    /* If the chain is empty, the word is not in the hash table */
+    elem = hashdata->hash_table[hash];
+    if (elem == ENDOFCHAIN) {
+        STATSCOUNT(hashdata, miss_probes, 0);
+        return NOTFOUND;
+    }
+    /* If we have found the word return counter value, only comparing the
+     * words themselves when the full hashes match */
+    if (elems[elem].hash == full_hash &&
+        ELEMMATCHES(elems[elem], text, curr_word)) {
+        STATSCOUNT(hashdata, hit_probes, counter);
         return counter;
     }
 
     /* Follow along hash chain until word is found */
-    temp_pointer = hashdata->hash_table[hash]->next;
-    while (temp_pointer != NULL) {
+    elem = elems[elem].next;
+    while (elem != ENDOFCHAIN) {
         counter++;
 
-        if (strcmp(temp_pointer->word, curr_word) == 0) {
+        if (elems[elem].hash == full_hash &&
+            ELEMMATCHES(elems[elem], text, curr_word)) {
+            STATSCOUNT(hashdata, hit_probes, counter);
             return counter;
         }
-        temp_pointer = temp_pointer->next;
+        elem = elems[elem].next;
+    }
+
+    STATSCOUNT(hashdata, miss_probes, counter);
+    return NOTFOUND;
+}
+
+/* FindWord that also moves the word up its chain when found, to the head
+ * or one place forward, so often searched words are found sooner. Changes
+ * the table, so is never used by the threaded or batched searches */
+int FindWordReorder(HashData *hashdata, char *curr_word)
+{
+    int hash, counter = 0;
+    unsigned int full_hash, elem, pred;
+    unsigned int *link, *prev_link = NULL;
+    HashElem *elems = hashdata->pool.elems;
+    char *text = hashdata->arena.text;
+#ifdef INLINE_KEYS
+    unsigned char key[KEYWIDTH];
+
+    /* Pad the word once, it is still a valid string for hashing */
+    PadWord(curr_word, key);
+    curr_word = (char *)key;
+#endif
+
+    full_hash = (unsigned int)hashdata->hash_family->hash(curr_word,\
+                                                         hashdata->hash_seed);
+    if (hashdata->filter.blocks != NULL &&
+        !FilterMayContain(&hashdata->filter, full_hash)) {
+        STATSCOUNT(hashdata, miss_probes, 0);
+        return NOTFOUND;
     }
-    fprintf(stderr, ERR_WORD_MISSING);
-    exit(word_not_found);
+    hash = FastMod(full_hash,\
+                   PrimeLadder[hashdata->prime_index].mod_mult,\
+                   hashdata->table_size);
+
+    /* link is whichever index points at elem, prev_link the one before */
+    link = &hashdata->hash_table[hash];
+    while ((elem = *link) != ENDOFCHAIN) {
+        counter++;
+
+        if (elems[elem].hash == full_hash &&
+            ELEMMATCHES(elems[elem], text, curr_word)) {
+            if (prev_link != NULL && hashdata->reorder == reorder_front) {
+                *link = elems[elem].next;
+                elems[elem].next = hashdata->hash_table[hash];
+                hashdata->hash_table[hash] = elem;
+            }
+            else if (prev_link != NULL &&
+                     hashdata->reorder == reorder_transpose) {
+                pred = *prev_link;
+                *prev_link = elem;
+                elems[pred].next = elems[elem].next;
+                elems[elem].next = pred;
+            }
+            STATSCOUNT(hashdata, hit_probes, counter);
+            return counter;
+        }
+        prev_link = link;
+        link = &elems[elem].next;
+    }
+
+    STATSCOUNT(hashdata, miss_probes, counter);
+    return NOTFOUND;
+}
+
+/* Looks up to BATCHSIZE words together, returning their total lookups. All
+ * the hashes are computed and buckets prefetched up front, then the words
+ * are resolved round robin, so while one word's next element or string is
+ * being fetched the others are being compared */
+int WordSearchBatch(HashData *hashdata, char **words, int num_words)
+{
+    int total_lookups = FindWordBatch(hashdata, words, num_words);
+
+    if (total_lookups == NOTFOUND) {
+        fprintf(stderr, ERR_WORD_MISSING);
+        exit(word_not_found);
+    }
+
+    return total_lookups;
+}
+
+/* Returns the total lookups taken to find the batch, or NOTFOUND if any of
+ * its words is missing. Only reads the table */
+int FindWordBatch(HashData *hashdata, char **words, int num_words)
+{
+    BatchProbe probes[BATCHSIZE];
+    BatchProbe *probe;
+    HashElem *elems = hashdata->pool.elems;
+#ifndef INLINE_KEYS
+    char *text = hashdata->arena.text;
+#endif
+    uint64_t full_hashes[BATCHSIZE];
+    uint64_t mod_mult = PrimeLadder[hashdata->prime_index].mod_mult;
+    int i, remaining = num_words, total_lookups = 0;
+
+    /* Hash the whole batch together, which may use the vector path */
+    hashdata->hash_family->hash_batch(hashdata->hash_family, words,\
+                                      num_words, hashdata->hash_seed,\
+                                      full_hashes);
+
+    for (i = 0; i < num_words; i++) {
+        probe = &probes[i];
+        probe->word = words[i];
+#ifdef INLINE_KEYS
+        PadWord(words[i], probe->key);
+#endif
+        probe->full_hash = (unsigned int)full_hashes[i];
+        probe->hash = FastMod(probe->full_hash, mod_mult, hashdata->table_size);
+        probe->counter = 1;
+        probe->stage = probe_bucket;
+        PREFETCH(&hashdata->hash_table[probe->hash]);
+    }
+
+    while (remaining > 0) {
+        for (i = 0; i < num_words; i++) {
+            probe = &probes[i];
+
+            if (probe->stage == probe_bucket) {
+                /* Start fetching the head of the chain */
+                probe->element = hashdata->hash_table[probe->hash];
+                probe->stage = probe_element;
+            }
+            else if (probe->stage == probe_element) {
+#ifdef INLINE_KEYS
+                /* The key is in the element, so is compared straight away */
+                if (elems[probe->element].hash == probe->full_hash &&
+                    KEYSEQUAL(elems[probe->element].key, probe->key)) {
+                    total_lookups += probe->counter;
+                    STATSCOUNT(hashdata, hit_probes, probe->counter);
+                    probe->stage = probe_done;
+                    remaining--;
+                    continue;
+                }
+#else
+                /* Matching hashes, fetch the word to compare on the next go */
+                if (elems[probe->element].hash == probe->full_hash) {
+                    PREFETCH(text + elems[probe->element].word);
+                    probe->stage = probe_word;
+                    continue;
+                }
+#endif
+                probe->element = elems[probe->element].next;
+                probe->counter++;
+            }
+#ifndef INLINE_KEYS
+            else if (probe->stage == probe_word) {
+                if (strcmp(text + elems[probe->element].word,\
+                           probe->word) == 0) {
+                    total_lookups += probe->counter;
+                    STATSCOUNT(hashdata, hit_probes, probe->counter);
+                    probe->stage = probe_done;
+                    remaining--;
+                    continue;
+                }
+                probe->element = elems[probe->element].next;
+                probe->counter++;
+                probe->stage = probe_element;
+            }
+#endif
+            else {
+                continue;
+            }
+
+            /* Reaching the end of the chain means the word is not there */
+            if (probe->element == ENDOFCHAIN) {
+                STATSCOUNT(hashdata, miss_probes, probe->counter - 1);
+                return NOTFOUND;
+            }
+            PREFETCH(&elems[probe->element]);
+        }
+    }
+
+    return total_lookups;
 }
@@ -1,11 +1,98 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
 
 #define MAXWORDLEN 15
 #define MAXLOADFRACTION 0.6
-#define SIZEINCREASE 2
+#define ARENASTARTSIZE 65536
+#define POOLSTARTSIZE 1024
+#define ENDOFCHAIN 0xFFFFFFFFu
+#define BATCHSIZE 16
+#define MAXTHREADS 256
+#define NOTFOUND (-1)
+#define KEYWIDTH 16
+#define DEFAULTSEED UINT64_C(0x9E3779B97F4A7C15)
+#define TIMERSAMPLES 1000
+#define PERFEVENTS 6
+#define LINESCANBLOCK 65536
+#define ENGINENAME "p2"
+#define SNAPMAGIC "SPLLSNAP"
+#define SNAPVERSION 1
+#define SNAPALIGN 64
+#define SNAPNAMELEN 16
+#define SNAPSEED UINT64_C(0xCBF29CE484222325)
+#define SNAPTEMPSUFFIX ".XXXXXX"
+#define FILTERWORDS 8
+#define FILTERBITSPERKEY 10
+#define FILTERALIGN 64
+#define TEXTBLOCKSIZE (1 << 18)
+#define TOKENSTARTSIZE 4096
+#define STATSPROBES 64
+
+/* Built with -DINLINE_KEYS, elements hold the word itself zero padded to
+ * KEYWIDTH bytes instead of an arena offset, & keys are compared whole.
+ * The word an element is matched against must then be padded too */
+#ifdef INLINE_KEYS
+#define ELEMMATCHES(elem, text, str) ((void)(text), KEYSEQUAL((elem).key, str))
+#else
+#define ELEMMATCHES(elem, text, str) (strcmp((text) + (elem).word, str) == 0)
+#endif
+
+/* Equality of two padded keys, one 16 byte compare & movemask with SSE2 */
+#ifdef __SSE2__
+#include <emmintrin.h>
+#define KEYSEQUAL(a, b) (_mm_movemask_epi8(_mm_cmpeq_epi8(\
+    _mm_loadu_si128((const __m128i *)(a)),\
+    _mm_loadu_si128((const __m128i *)(b)))) == 0xFFFF)
+#else
+#define KEYSEQUAL(a, b) (memcmp(a, b, KEYWIDTH) == 0)
+#endif
+
+/* Software prefetch hint, a no-op on compilers without the builtin */
+#ifdef __GNUC__
+#define PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define PREFETCH(addr) ((void)(addr))
+#endif
+
+/* Built with -DTABLE_STATS, inserts & lookups count the elements they look
+ * at into the histograms of hashdata->stats, the last bucket holding every
+ * longer count. Otherwise the counting compiles away */
+#ifdef TABLE_STATS
+#define STATSCOUNT(hashdata, histogram, length)\
+    ((hashdata)->stats->histogram[(length) < STATSPROBES ?\
+                                  (length) : STATSPROBES - 1]++)
+#define STATSBYTES(hashdata, bytes)\
+    ((hashdata)->stats->bytes_allocated += (bytes))
+#else
+#define STATSCOUNT(hashdata, histogram, length) ((void)(length))
+#define STATSBYTES(hashdata, bytes) ((void)(bytes))
+#endif
+
+/* Atomic access to the pipeline's queue positions, falling back to one
+ * shared lock on compilers without the builtins */
+#ifdef __GNUC__
+#define ATOMICLOAD(ptr) __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define ATOMICSTORE(ptr, value) __atomic_store_n(ptr, value, __ATOMIC_RELEASE)
+#define ATOMICSWAPIF(ptr, expected, desired) __atomic_compare_exchange_n(\
+    ptr, expected, desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#else
+#define ATOMICLOAD(ptr) AtomicLoad(ptr)
+#define ATOMICSTORE(ptr, value) AtomicStore(ptr, value)
+#define ATOMICSWAPIF(ptr, expected, desired)\
+    AtomicSwapIf(ptr, expected, desired)
+#endif
 
 /* Error Print Statements */
 #define ERR_NO_FILE      "ERROR - 2 filenames need to be passed to the program.\n"
@@ -15,18 +102,256 @@
 #define ERR_WORD_MISSING "ERROR - A word was not found in the hash table.\n"
 #define ERR_EMPTY_FILE   "ERROR - No words were found in the test search file.\n"
 #define ERR_LONG_STR     "ERROR - A word in the dictionary is > MAXWORDLEN.\n"
+#define ERR_NO_MEMORY    "ERROR - Failed to allocate memory for the hash table.\n"
+#define ERR_BAD_HASH     "ERROR - Unknown hash function name passed to -hash.\n"
+#define ERR_THREAD_FAIL  "ERROR - Failed to start a search thread.\n"
+#define ERR_BAD_OPTION   "ERROR - Unrecognised option passed to the program.\n"
+#define ERR_TABLE_MAX    "ERROR - Hash table cannot grow past the largest prime.\n"
+#define ERR_READ_FAIL    "ERROR - Failed to read the text to spell check.\n"
 
+/* Warning Print Statements */
+#define WARN_SNAP_WRITE  "WARNING - Failed to write the table snapshot, carrying on.\n"
+
+/* A chain element, the word's arena offset (or inline key) & the pool index
+ * of the next element, or ENDOFCHAIN. The word's full hash rejects
+ * mismatches without touching the word, and resizing never calls HashFunc */
 typedef struct HashTableElement {
-    char *word;
-    struct HashTableElement *next;
+#ifdef INLINE_KEYS
+    unsigned char key[KEYWIDTH];
+#else
+    unsigned int word;
+#endif
+    unsigned int next;
+    unsigned int hash;
 } HashElem;
 
+/* Every chain element in one array, the table & chains hold indices into it */
+typedef struct ElementPool {
+    HashElem *elems;
+    unsigned int used;
+    unsigned int size;
+} ElemPool;
+
+/* Bump allocated store for all words, elements hold offsets into it */
+typedef struct StringArena {
+    char *text;
+    unsigned int used;
+    unsigned int size;
+    int mapped;
+} StrArena;
+
+/* A selectable hash function, the chains use the low 32 bits of its 64 bit
+ * value. hash_batch hashes many words at once */
+typedef struct HashFamilyEntry HashFamily;
+typedef uint64_t (*WordHashFunc)(char *str, uint64_t seed);
+typedef void (*WordHashBatchFunc)(const HashFamily *family, char **words,
+                                  int num_words, uint64_t seed,
+                                  uint64_t *hashes);
+struct HashFamilyEntry {
+    char *name;
+    WordHashFunc hash;
+    WordHashBatchFunc hash_batch;
+};
+
+/* The start of a table snapshot file. Everything up to prime_index must
+ * match the current build for the snapshot to be used, the buckets, pool
+ * elements & arena follow at the given offsets, so the file can be mapped
+ * anywhere. The checksum covers the header, with checksum 0, & the rest */
+typedef struct SnapshotHeader {
+    char magic[8];
+    char engine[8];
+    unsigned int version;
+    unsigned int elem_size;
+    uint64_t dict_size;
+    int64_t dict_mtime_sec;
+    int64_t dict_mtime_nsec;
+    char hash_name[SNAPNAMELEN];
+    uint64_t hash_seed;
+    int check_duplicates;
+    int presize;
+    int start_prime_index;
+    int prime_index;
+    int table_size;
+    int word_count;
+    unsigned int elem_count;
+    unsigned int arena_used;
+    uint64_t buckets_offset;
+    uint64_t elems_offset;
+    uint64_t arena_offset;
+    uint64_t file_size;
+    uint64_t checksum;
+} SnapHeader;
+
+/* One word's progress through a batched lookup */
+typedef struct BatchProbeState {
+    char *word;
+#ifdef INLINE_KEYS
+    unsigned char key[KEYWIDTH];
+#endif
+    unsigned int full_hash;
+    int hash;
+    unsigned int element;
+    int counter;
+    int stage;
+} BatchProbe;
+
+/* A table size on the growth ladder, with the fastmod multiplier needed to
+ * reduce a hash modulo prime without dividing */
+typedef struct PrimeLadderStep {
+    unsigned int prime;
+    uint64_t mod_mult;
+} PrimeStep;
+
+/* A blocked Bloom filter of the stored words. A word sets one bit in each
+ * of the FILTERWORDS words of a single block, so testing it reads one cache
+ * line */
+typedef struct BloomFilterData {
+    unsigned int *blocks;
+    unsigned int num_blocks;
+} BloomFilter;
+
+/* A word file mapped into memory, words are filtered & terminated in place */
+typedef struct MappedWordFile {
+    char *text;
+    size_t size;
+    size_t pos;
+} MapFile;
+
+/* Counters kept with -DTABLE_STATS. Threads searching a shared table each
+ * count into their own, merged once they finish */
+typedef struct TableStatsData {
+    unsigned long insert_probes[STATSPROBES];
+    unsigned long hit_probes[STATSPROBES];
+    unsigned long miss_probes[STATSPROBES];
+    /* Every table, pool, arena & filter allocated, each growth counting
+     * its new size, including those since freed */
+    unsigned long bytes_allocated;
+} TableStats;
+
+/* One perf_event_open counter per event, -1 if it could not be opened,
+ * & the counts from the last PerfStop, -1 if not counted */
+typedef struct PerfCounterSet {
+    int fds[PERFEVENTS];
+    double counts[PERFEVENTS];
+} PerfCounters;
+
 typedef struct HashTableData {
-    HashElem **hash_table;
+    unsigned int *hash_table;
+    int prime_index;
     int table_size;
     int max_table_load;
+    int word_count;
+    /* Hash function chosen at startup, and its seed */
+    const HashFamily *hash_family;
+    uint64_t hash_seed;
+    StrArena arena;
+    ElemPool pool;
+    /* Resizes so far & the wall clock time spent in them */
+    int resize_count;
+    double resize_seconds;
+    /* Count the dictionary's lines first & size the table for them once */
+    int presize;
+    /* Skip dictionary words already in the table */
+    int check_duplicates;
+    /* Reorder_Modes, how found words move up their chain in WordSearch */
+    int reorder;
+    /* CreateHashTable maps this snapshot file instead of building the table
+     * when it is up to date, else writes it. A mapped snapshot is read only */
+    char *snapshot_name;
+    char *snapshot;
+    size_t snapshot_size;
+    /* CreateHashTable also builds a filter of the words when set, which
+     * FindWord checks first so most missing words never reach the table */
+    int use_filter;
+    BloomFilter filter;
+    /* Look words up BATCHSIZE at a time in HashSearchTest */
+    int batch_lookups;
+    /* Split HashSearchTest over this many threads when more than 1 */
+    int num_threads;
+    /* Count hardware events around the benchmark's build & search */
+    int perf_counters;
+#ifdef TABLE_STATS
+    TableStats *stats;
+#endif
 } HashData;
 
+/* Every word of a test file, gathered so it can be split between threads.
+ * Words point into the mapped file, or into buf when it could not be mapped */
+typedef struct TestWordList {
+    char **words;
+    int count;
+    MapFile map;
+    char *buf;
+} WordList;
+
+/* One search thread's share of the words, and what it found */
+typedef struct SearchWorkerData {
+    HashData *hashdata;
+    char **words;
+    int num_words;
+    double total_lookups;
+    int status;
+#ifdef TABLE_STATS
+    TableStats stats;
+#endif
+} SearchWorker;
+
+/* A word of streamed text, found at offset in its block. Its line counts
+ * from the block's first, its column from 1 on that line of the text */
+typedef struct TextToken {
+    unsigned int offset;
+    unsigned int len;
+    unsigned int line;
+    long column;
+} Token;
+
+/* A block of streamed text cut at a line end, numbered by seq in reading
+ * order, & its words once tokenized. Unknown words are moved to the front
+ * of tokens by the lookup stage */
+typedef struct StreamTextBlock {
+    char *text;
+    size_t len;
+    unsigned long seq;
+    /* Column the block starts at, when it was cut part way through a line */
+    long start_column;
+    int ends_line;
+    unsigned int line_count;
+    Token *tokens;
+    int token_count;
+    int token_size;
+    int unknown_count;
+} TextBlock;
+
+/* One cell of a block queue, whose seq says whether it is free to push to
+ * or ready to pop on the current lap */
+typedef struct BlockQueueCell {
+    volatile unsigned long seq;
+    TextBlock *block;
+} QueueCell;
+
+/* A bounded lock-free queue of blocks, of a power of 2 cells */
+typedef struct BlockQueueData {
+    QueueCell *cells;
+    unsigned long mask;
+    volatile unsigned long head;
+    volatile unsigned long tail;
+} BlockQueue;
+
+/* The streaming spell check's stages & the queues between them. Blocks
+ * go from free_blocks through each queue in turn & back again */
+typedef struct StreamPipeline {
+    HashData *hashdata;
+    int num_blocks;
+    BlockQueue free_blocks;
+    BlockQueue to_tokenize;
+    BlockQueue to_lookup;
+    BlockQueue to_write;
+    /* Totals kept by the writer */
+    long word_count;
+    long line_count;
+    long unknown_count;
+} Pipeline;
+
 enum Exit_Codes {
     no_file_passed = 5,
     fopen_fail = 6,
@@ -34,7 +359,24 @@ enum Exit_Codes {
     hash_table_full = 8,
     word_not_found = 9,
     search_file_empty = 10,
-    str_too_long = 11
+    str_too_long = 11,
+    out_of_memory = 12,
+    bad_option = 13,
+    thread_fail = 14,
+    read_fail = 15
+};
+
+enum Reorder_Modes {
+    reorder_none,
+    reorder_front,
+    reorder_transpose
+};
+
+enum Probe_Stages {
+    probe_bucket,
+    probe_element,
+    probe_word,
+    probe_done
 };
 
 enum Boolean {
@@ -43,12 +385,111 @@ enum Boolean {
 };
 
 void InitialiseHashData(HashData *hashdata, int size);
+void NewHashTable(HashData *hashdata, int prime_index);
 void CreateHashTable(HashData *hashdata, char *filename);
+void BuildHashTable(HashData *hashdata, char *filename);
 void LoadNextWord(char *curr_word, FILE *txt_file);
-void AddToHashTable(HashData *hashdata, char *curr_word);
+int MapWordFile(MapFile *map_file, char *filename);
+char *NextMappedWord(MapFile *map_file);
+void UnmapWordFile(MapFile *map_file);
+int AddToHashTable(HashData *hashdata, char *curr_word);
+int InsertElement(HashData *hashdata, unsigned int word,
+                  unsigned int full_hash);
+unsigned int PoolAddElement(HashData *hashdata);
+unsigned int ArenaAddWord(HashData *hashdata, char *curr_word);
+char *ArenaGrow(StrArena *arena);
 unsigned int HashFunc(char *str);
+uint64_t HashClassic(char *str, uint64_t seed);
 void ResizeHashTable(HashData *hashdata);
-int PrimeReturn(int test);
-void FreeHashTable(HashElem **hash_table, int table_size);
+void RehashTable(HashData *hashdata, int prime_index);
+void ReserveCapacity(HashData *hashdata, long capacity);
+int CapacityIndex(long capacity);
+long CountLines(char *text, size_t size);
+long CountFileLines(char *filename);
+int PrimeIndex(int size);
+int OnPrimeLadder(int prime_index, int table_size);
+double WallSeconds(void);
+unsigned int FastMod(unsigned int a, uint64_t mod_mult, unsigned int d);
+void FreeHashTable(HashData *hashdata);
 double HashSearchTest(HashData *hashdata, char *filename);
-int WordSearch(HashData *hashdata, char *curr_word);
\ No newline at end of file
+int WordSearch(HashData *hashdata, char *curr_word);
+int FindWord(HashData *hashdata, char *curr_word);
+int FindWordReorder(HashData *hashdata, char *curr_word);
+int WordSearchBatch(HashData *hashdata, char **words, int num_words);
+int FindWordBatch(HashData *hashdata, char **words, int num_words);
+/* Multi-threaded search, psearch.c */
+double ParallelSearchTest(HashData *hashdata, char *filename);
+void LoadWordList(WordList *word_list, char *filename);
+void FreeWordList(WordList *word_list);
+void *SearchWorkerMain(void *worker_data);
+/* Table snapshots, snapshot.c */
+int LoadSnapshot(HashData *hashdata, SnapHeader *expected);
+void SaveSnapshot(HashData *hashdata, SnapHeader *identity);
+int SnapshotIdentity(HashData *hashdata, char *dict_name, SnapHeader *header);
+uint64_t SnapshotChecksum(uint64_t hash, unsigned char *data, size_t size);
+uint64_t SnapAlign(uint64_t offset);
+int WriteSnapshotBlock(void *data, size_t size, FILE *snap_file);
+/* Spell check mode & the word filter, spell.c */
+void SpellCheckTest(HashData *hashdata, char *filename);
+void BuildWordFilter(HashData *hashdata);
+uint64_t FilterHash(uint64_t key_hash);
+unsigned int *FilterBlock(BloomFilter *filter, uint64_t filter_hash);
+void FilterAdd(BloomFilter *filter, uint64_t key_hash);
+int FilterMayContain(BloomFilter *filter, uint64_t key_hash);
+int FilterRejects(HashData *hashdata, char *curr_word);
+/* Streaming spell check, pipeline.c */
+long StreamSpellCheck(HashData *hashdata, char *filename);
+void ReadTextBlocks(Pipeline *pipeline, FILE *text_file);
+void *TokenizerMain(void *pipeline_data);
+void AddToken(TextBlock *block, size_t offset, size_t len, unsigned int line,
+              long column);
+void *LookupMain(void *pipeline_data);
+int KnownWord(HashData *hashdata, char *word, unsigned int len);
+void *WriterMain(void *pipeline_data);
+void NewBlockQueue(BlockQueue *queue, int capacity);
+int QueueTryPush(BlockQueue *queue, TextBlock *block);
+TextBlock *QueueTryPop(BlockQueue *queue);
+void QueuePush(BlockQueue *queue, TextBlock *block);
+TextBlock *QueuePop(BlockQueue *queue);
+#ifndef __GNUC__
+unsigned long AtomicLoad(volatile unsigned long *ptr);
+void AtomicStore(volatile unsigned long *ptr, unsigned long value);
+int AtomicSwapIf(volatile unsigned long *ptr, unsigned long *expected,
+                 unsigned long desired);
+#endif
+/* Table statistics, stats.c */
+void DumpTableStats(HashData *hashdata, char *filename);
+void ChainLengths(HashData *hashdata, unsigned long *chains);
+void PrintHistogram(FILE *stats_file, char *name, unsigned long *counts,
+                    int num_counts);
+#ifdef TABLE_STATS
+void MergeTableStats(TableStats *total, TableStats *stats);
+#endif
+/* Hardware event counters, perf.c */
+void PerfOpen(PerfCounters *perf);
+void PerfStart(PerfCounters *perf);
+void PerfStop(PerfCounters *perf);
+void PerfClose(PerfCounters *perf);
+void PrintPerfJson(PerfCounters *perf, char *name, double keys);
+/* Benchmark mode, bench.c */
+void RunBenchmark(HashData *hashdata, char *dict_name, char *test_name);
+double TimerOverhead(void);
+int CompareDoubles(const void *a, const void *b);
+double Percentile(double *sorted, int count, double fraction);
+void PrintJsonString(char *str);
+/* Hash function family, hashfuncs.c */
+extern const HashFamily HashFamilies[];
+const HashFamily *FindHashFamily(char *name);
+unsigned int PadWord(char *str, unsigned char *block);
+void Mul128(uint64_t a, uint64_t b, uint64_t *low, uint64_t *high);
+uint64_t MulFold64(uint64_t a, uint64_t b);
+uint64_t Read64(unsigned char *bytes);
+uint64_t HashWy(char *str, uint64_t seed);
+uint64_t HashXxh3(char *str, uint64_t seed);
+unsigned int Mix32Lane(unsigned int *words, unsigned int len,
+                       unsigned int seed);
+uint64_t HashMix32(char *str, uint64_t seed);
+void HashBatchScalar(const HashFamily *family, char **words, int num_words,
+                     uint64_t seed, uint64_t *hashes);
+void HashBatchMix32(const HashFamily *family, char **words, int num_words,
+                    uint64_t seed, uint64_t *hashes);
\ No newline at end of file
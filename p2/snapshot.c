@@ -0,0 +1,234 @@
+#include "shash.h"
+
+/* Maps an up to date snapshot of the dictionary's table in place of the
+ * current empty table, so lookups are served straight from the file with
+ * no rebuild. Returns false, leaving the table alone, if the snapshot is
+ * missing, does not have the expected identity or is damaged */
+int LoadSnapshot(HashData *hashdata, SnapHeader *expected)
+{
+    SnapHeader header;
+    struct stat file_stat;
+    uint64_t checksum;
+    char *base;
+    int fd;
+
+    fd = open(hashdata->snapshot_name, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    if (fstat(fd, &file_stat) != 0 ||
+        (size_t)file_stat.st_size < sizeof(SnapHeader)) {
+        close(fd);
+        return false;
+    }
+    /* Shared & read only, so every process serving it shares its pages */
+    base = mmap(NULL, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+    memcpy(&header, base, sizeof(SnapHeader));
+
+    /* Check the identity, that the table is a size on the ladder & that the
+     * sections lie inside the file before reading them for the checksum */
+    if (memcmp(&header, expected, offsetof(SnapHeader, prime_index)) != 0 ||
+        header.file_size != (uint64_t)file_stat.st_size ||
+        !OnPrimeLadder(header.prime_index, header.table_size) ||
+        header.buckets_offset < sizeof(SnapHeader) ||
+        header.elems_offset < header.buckets_offset +\
+            (uint64_t)header.table_size * sizeof(unsigned int) ||
+        header.arena_offset < header.elems_offset +\
+            (uint64_t)header.elem_count * sizeof(HashElem) ||
+        header.arena_used == 0 ||
+        header.arena_offset + header.arena_used > header.file_size ||
+        base[header.arena_offset + header.arena_used - 1] != '\0') {
+        munmap(base, file_stat.st_size);
+        return false;
+    }
+
+    checksum = header.checksum;
+    header.checksum = 0;
+    if (SnapshotChecksum(SnapshotChecksum(SnapshotChecksum(SnapshotChecksum(\
+            SnapshotChecksum(SNAPSEED, (unsigned char *)&header,\
+                             sizeof(SnapHeader)),\
+            (unsigned char *)base + header.buckets_offset,\
+            header.table_size * sizeof(unsigned int)),\
+            (unsigned char *)base + header.elems_offset,\
+            header.elem_count * sizeof(HashElem)),\
+            (unsigned char *)base + header.arena_offset,\
+            header.arena_used - 1),\
+            (unsigned char *)base + header.arena_offset +\
+            header.arena_used - 1, 1) != checksum) {
+        munmap(base, file_stat.st_size);
+        return false;
+    }
+
+    /* Serve from the mapping in place of the empty table, pool & arena */
+    free(hashdata->hash_table);
+    free(hashdata->pool.elems);
+    free(hashdata->arena.text);
+    hashdata->hash_table = (unsigned int *)(base + header.buckets_offset);
+    hashdata->prime_index = header.prime_index;
+    hashdata->table_size = header.table_size;
+    hashdata->max_table_load = (int)(header.table_size * MAXLOADFRACTION);
+    hashdata->word_count = header.word_count;
+    hashdata->pool.elems = (HashElem *)(base + header.elems_offset);
+    hashdata->pool.used = header.elem_count;
+    hashdata->pool.size = header.elem_count;
+    hashdata->arena.text = base + header.arena_offset;
+    hashdata->arena.used = header.arena_used;
+    hashdata->arena.size = header.arena_used;
+    hashdata->arena.mapped = false;
+    hashdata->snapshot = base;
+    hashdata->snapshot_size = file_stat.st_size;
+
+    return true;
+}
+
+/* Writes the built table, its element pool & arena to the snapshot file,
+ * after a header of the identity taken before it was built */
+void SaveSnapshot(HashData *hashdata, SnapHeader *identity)
+{
+    static char padding[SNAPALIGN];
+    SnapHeader header;
+    size_t buckets_size, elems_size;
+    char *temp_name;
+    FILE *snap_file = NULL;
+    int fd, written;
+
+    header = *identity;
+
+    buckets_size = hashdata->table_size * sizeof(unsigned int);
+    elems_size = hashdata->pool.used * sizeof(HashElem);
+    header.prime_index = hashdata->prime_index;
+    header.table_size = hashdata->table_size;
+    header.word_count = hashdata->word_count;
+    header.elem_count = hashdata->pool.used;
+    /* A NUL follows the arena, the last word of a dictionary with no final
+     * newline being terminated only by its mapping's zeroed tail */
+    header.arena_used = hashdata->arena.used + 1;
+    header.buckets_offset = SnapAlign(sizeof(SnapHeader));
+    header.elems_offset = SnapAlign(header.buckets_offset + buckets_size);
+    header.arena_offset = SnapAlign(header.elems_offset + elems_size);
+    header.file_size = header.arena_offset + header.arena_used;
+    header.checksum = SnapshotChecksum(SnapshotChecksum(SnapshotChecksum(\
+        SnapshotChecksum(SnapshotChecksum(SNAPSEED,\
+        (unsigned char *)&header, sizeof(SnapHeader)),\
+        (unsigned char *)hashdata->hash_table, buckets_size),\
+        (unsigned char *)hashdata->pool.elems, elems_size),\
+        (unsigned char *)hashdata->arena.text, hashdata->arena.used),\
+        (unsigned char *)padding, 1);
+
+    /* Written under a unique temporary name then renamed over the snapshot,
+     * so a process mapping it never sees a half written file & processes
+     * saving it at once do not mix their writes. Failing to save it only
+     * loses the snapshot, the table itself is built, so is warned of */
+    temp_name = malloc(strlen(hashdata->snapshot_name) +\
+                       sizeof(SNAPTEMPSUFFIX));
+    if (temp_name == NULL) {
+        fprintf(stderr, ERR_NO_MEMORY);
+        exit(out_of_memory);
+    }
+    strcpy(temp_name, hashdata->snapshot_name);
+    strcat(temp_name, SNAPTEMPSUFFIX);
+
+    fd = mkstemp(temp_name);
+    if (fd >= 0) {
+        /* mkstemp makes it private, but it is shared with other users */
+        fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+        snap_file = fdopen(fd, "wb");
+        if (snap_file == NULL) {
+            close(fd);
+        }
+    }
+    written = snap_file != NULL &&
+        WriteSnapshotBlock(&header, sizeof(SnapHeader), snap_file) &&
+        WriteSnapshotBlock(padding,\
+            header.buckets_offset - sizeof(SnapHeader), snap_file) &&
+        WriteSnapshotBlock(hashdata->hash_table, buckets_size, snap_file) &&
+        WriteSnapshotBlock(padding,\
+            header.elems_offset - header.buckets_offset - buckets_size,\
+            snap_file) &&
+        WriteSnapshotBlock(hashdata->pool.elems, elems_size, snap_file) &&
+        WriteSnapshotBlock(padding,\
+            header.arena_offset - header.elems_offset - elems_size,\
+            snap_file) &&
+        WriteSnapshotBlock(hashdata->arena.text, hashdata->arena.used,\
+                           snap_file) &&
+        WriteSnapshotBlock(padding, 1, snap_file);
+    if (snap_file != NULL && fclose(snap_file) != 0) {
+        written = false;
+    }
+    if (written && rename(temp_name, hashdata->snapshot_name) != 0) {
+        written = false;
+    }
+    if (!written) {
+        if (fd >= 0) {
+            unlink(temp_name);
+        }
+        fprintf(stderr, WARN_SNAP_WRITE);
+    }
+    free(temp_name);
+}
+
+/* Fills in a header's identity, the fields a snapshot must share with the
+ * current build: its format, the table options, the empty table's size &
+ * the dictionary's size & modification time. Taken before the table is
+ * built, as -reserve sets its starting size. Returns false if the
+ * dictionary cannot be found */
+int SnapshotIdentity(HashData *hashdata, char *dict_name, SnapHeader *header)
+{
+    struct stat dict_stat;
+
+    /* Zero the padding too, the whole header is compared & checksummed */
+    memset(header, 0, sizeof(SnapHeader));
+    if (stat(dict_name, &dict_stat) != 0) {
+        return false;
+    }
+
+    memcpy(header->magic, SNAPMAGIC, sizeof(header->magic));
+    strncpy(header->engine, ENGINENAME, sizeof(header->engine) - 1);
+    header->version = SNAPVERSION;
+    header->elem_size = sizeof(HashElem);
+    header->dict_size = dict_stat.st_size;
+    header->dict_mtime_sec = dict_stat.st_mtim.tv_sec;
+    header->dict_mtime_nsec = dict_stat.st_mtim.tv_nsec;
+    strncpy(header->hash_name, hashdata->hash_family->name, SNAPNAMELEN - 1);
+    header->hash_seed = hashdata->hash_seed;
+    header->check_duplicates = hashdata->check_duplicates;
+    header->presize = hashdata->presize;
+    header->start_prime_index = hashdata->prime_index;
+
+    return true;
+}
+
+/* Continues a 64 bit checksum over a block, 8 bytes at a time, then any
+ * bytes left over. Blocks must be checksummed in the same pieces each time */
+uint64_t SnapshotChecksum(uint64_t hash, unsigned char *data, size_t size)
+{
+    uint64_t block;
+    size_t i;
+
+    for (i = 0; i + sizeof(block) <= size; i += sizeof(block)) {
+        memcpy(&block, data + i, sizeof(block));
+        hash = (hash ^ block) * UINT64_C(0x100000001B3);
+        hash ^= hash >> 29;
+    }
+    for (; i < size; i++) {
+        hash = (hash ^ data[i]) * UINT64_C(0x100000001B3);
+    }
+    return hash;
+}
+
+/* Rounds a file offset up to the next SNAPALIGN boundary */
+uint64_t SnapAlign(uint64_t offset)
+{
+    return (offset + SNAPALIGN - 1) / SNAPALIGN * SNAPALIGN;
+}
+
+/* Writes a block of the snapshot, returning false if it cannot all be
+ * written */
+int WriteSnapshotBlock(void *data, size_t size, FILE *snap_file)
+{
+    return size == 0 || fwrite(data, 1, size, snap_file) == size;
+}
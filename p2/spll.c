@@ -1,28 +1,230 @@
 #include "shash.h"
 #define STARTSIZE 1000
 
+void ReportHashFamilies(HashData *options, char *dict_name, char *test_name);
+
 int main(int argc, char **argv)
 {
     HashData hashdata;
+    char *stats_name = NULL;
+    int i, hash_report = false, bench = false, spell = false, stream = false;
     InitialiseHashData(&hashdata, STARTSIZE);
 
     /* Exit if not passed a dictionary and word test file */
-    if (argc != 3) {
+    if (argc < 3) {
         fprintf(stderr, ERR_NO_FILE);
         exit(no_file_passed);
     }
 
+    /* Any further arguments switch on optional table modes */
+    for (i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "-batch") == 0) {
+            hashdata.batch_lookups = true;
+        }
+        /* -threads 0 uses one thread per online core */
+        else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) {
+            i++;
+            hashdata.num_threads = atoi(argv[i]);
+            if (hashdata.num_threads <= 0) {
+                hashdata.num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+            }
+        }
+        else if (strcmp(argv[i], "-hash") == 0 && i + 1 < argc) {
+            i++;
+            hashdata.hash_family = FindHashFamily(argv[i]);
+            if (hashdata.hash_family == NULL) {
+                fprintf(stderr, ERR_BAD_HASH);
+                exit(bad_option);
+            }
+        }
+        else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc) {
+            i++;
+            hashdata.hash_seed = strtoul(argv[i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "-hashreport") == 0) {
+            hash_report = true;
+        }
+        else if (strcmp(argv[i], "-presize") == 0) {
+            hashdata.presize = true;
+        }
+        /* -reserve N sizes the table for N words before loading any */
+        else if (strcmp(argv[i], "-reserve") == 0 && i + 1 < argc) {
+            i++;
+            ReserveCapacity(&hashdata, atol(argv[i]));
+        }
+        else if (strcmp(argv[i], "-unique") == 0) {
+            hashdata.check_duplicates = true;
+        }
+        /* Move found words to the front of their chain, or one step up */
+        else if (strcmp(argv[i], "-mtf") == 0) {
+            hashdata.reorder = reorder_front;
+        }
+        else if (strcmp(argv[i], "-transpose") == 0) {
+            hashdata.reorder = reorder_transpose;
+        }
+        /* -snapshot FILE maps FILE's table if it is up to date, else
+         * builds the table & writes FILE for the next run */
+        else if (strcmp(argv[i], "-snapshot") == 0 && i + 1 < argc) {
+            i++;
+            hashdata.snapshot_name = argv[i];
+        }
+        /* -stats FILE writes the table's statistics to FILE as JSON once
+         * the test has run, or to stdout for "-". Rejected with -bench or
+         * -hashreport, which build tables of their own */
+        else if (strcmp(argv[i], "-stats") == 0 && i + 1 < argc) {
+            i++;
+            stats_name = argv[i];
+        }
+        else if (strcmp(argv[i], "-bench") == 0) {
+            bench = true;
+        }
+        /* -perf adds hardware event counts per key to -bench's output, so
+         * is rejected without -bench */
+        else if (strcmp(argv[i], "-perf") == 0) {
+            hashdata.perf_counters = true;
+        }
+        /* -spell lists the test words missing from the dictionary */
+        else if (strcmp(argv[i], "-spell") == 0) {
+            spell = true;
+            hashdata.use_filter = true;
+        }
+        /* -stream spell checks free form text, or stdin if given "-", over
+         * a pipeline of -threads threads */
+        else if (strcmp(argv[i], "-stream") == 0) {
+            stream = true;
+            hashdata.use_filter = true;
+        }
+        else {
+            fprintf(stderr, ERR_BAD_OPTION);
+            exit(bad_option);
+        }
+    }
+
+    /* The benchmark & hash report never reach the statistics dump */
+    if (stats_name != NULL && (bench || hash_report)) {
+        fprintf(stderr, ERR_BAD_OPTION);
+        exit(bad_option);
+    }
+
+    /* The counters only run around the benchmark's build & search */
+    if (hashdata.perf_counters && !bench) {
+        fprintf(stderr, ERR_BAD_OPTION);
+        exit(bad_option);
+    }
+
+    /* Compare every hash family instead of running the normal test */
+    if (hash_report) {
+        ReportHashFamilies(&hashdata, argv[1], argv[2]);
+        FreeHashTable(&hashdata);
+        return 0;
+    }
+
+    /* Print machine readable timings instead of the normal test */
+    if (bench) {
+        RunBenchmark(&hashdata, argv[1], argv[2]);
+        FreeHashTable(&hashdata);
+        return 0;
+    }
+
+    /* A mapped snapshot is read only, so is not used if reordering chains */
+    if (hashdata.reorder != reorder_none) {
+        hashdata.snapshot_name = NULL;
+    }
+
     /* Set up the hash table for the given dictionary file */
     CreateHashTable(&hashdata, argv[1]);
 
+    /* Report every unknown word of the text instead of the normal test */
+    if (stream) {
+        StreamSpellCheck(&hashdata, argv[2]);
+        if (stats_name != NULL) {
+            DumpTableStats(&hashdata, stats_name);
+        }
+        FreeHashTable(&hashdata);
+        return 0;
+    }
+
+    /* Report every unknown word instead of the normal test */
+    if (spell) {
+        SpellCheckTest(&hashdata, argv[2]);
+        if (stats_name != NULL) {
+            DumpTableStats(&hashdata, stats_name);
+        }
+        FreeHashTable(&hashdata);
+        return 0;
+    }
+
     /* Search for the test words in the hash table */
     printf("Table size = %d. ", hashdata.table_size);
     printf("The words took an average of %f lookups to find.\n",\
             HashSearchTest(&hashdata, argv[2])
     );
 
+    if (stats_name != NULL) {
+        DumpTableStats(&hashdata, stats_name);
+    }
+    
     /* Free up all dynamically allocated space using in the hash table */
-    FreeHashTable(hashdata.hash_table, hashdata.table_size);
+    FreeHashTable(&hashdata);
 
     return 0;
-}
\ No newline at end of file
+}
+
+/* Builds the table with each hash family in turn, reporting its average
+ * lookups and the time taken to hash the test words, one at a time and
+ * through the family's batch path */
+void ReportHashFamilies(HashData *options, char *dict_name, char *test_name)
+{
+    HashData hashdata;
+    WordList word_list;
+    const HashFamily *family;
+    uint64_t hashes[BATCHSIZE];
+    volatile uint64_t sink = 0;
+    double start, average, scalar_ns, batch_ns;
+    int i, j, batch_count;
+
+    LoadWordList(&word_list, test_name);
+    if (word_list.count == 0) {
+        fprintf(stderr, ERR_EMPTY_FILE);
+        exit(search_file_empty);
+    }
+
+    for (family = HashFamilies; family->name != NULL; family++) {
+        /* Build & search a fresh table with the same modes as options */
+        InitialiseHashData(&hashdata, STARTSIZE);
+        hashdata.hash_family = family;
+        hashdata.hash_seed = options->hash_seed;
+        hashdata.presize = options->presize;
+        hashdata.check_duplicates = options->check_duplicates;
+        hashdata.reorder = options->reorder;
+        hashdata.batch_lookups = options->batch_lookups;
+        hashdata.num_threads = options->num_threads;
+        CreateHashTable(&hashdata, dict_name);
+        average = HashSearchTest(&hashdata, test_name);
+        FreeHashTable(&hashdata);
+
+        start = WallSeconds();
+        for (i = 0; i < word_list.count; i++) {
+            sink ^= family->hash(word_list.words[i], options->hash_seed);
+        }
+        scalar_ns = (WallSeconds() - start) * 1e9 / word_list.count;
+
+        start = WallSeconds();
+        for (i = 0; i < word_list.count; i += batch_count) {
+            batch_count = word_list.count - i < BATCHSIZE ?\
+                word_list.count - i : BATCHSIZE;
+            family->hash_batch(family, word_list.words + i, batch_count,\
+                               options->hash_seed, hashes);
+            for (j = 0; j < batch_count; j++) {
+                sink ^= hashes[j];
+            }
+        }
+        batch_ns = (WallSeconds() - start) * 1e9 / word_list.count;
+
+        printf("%-8s average lookups %f, hashing %.2f ns/key, "
+               "%.2f ns/key batched\n",
+               family->name, average, scalar_ns, batch_ns);
+    }
+
+    FreeWordList(&word_list);
+}
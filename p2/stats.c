@@ -0,0 +1,105 @@
+#include "shash.h"
+
+/* Writes the table's statistics as one JSON object to the file, or stdout
+ * for "-". The chain lengths & memory use are read off the table as it is
+ * now, the probe length histograms need a build with -DTABLE_STATS */
+void DumpTableStats(HashData *hashdata, char *filename)
+{
+    unsigned long chains[STATSPROBES];
+    unsigned long bytes_in_use;
+    FILE *stats_file;
+
+    ChainLengths(hashdata, chains);
+    bytes_in_use =\
+        (unsigned long)hashdata->table_size * sizeof(unsigned int) +\
+        (unsigned long)hashdata->pool.size * sizeof(HashElem) +\
+        hashdata->arena.size +\
+        hashdata->filter.num_blocks * FILTERWORDS * sizeof(unsigned int);
+
+    if (strcmp(filename, "-") == 0) {
+        stats_file = stdout;
+    }
+    else {
+        stats_file = fopen(filename, "w");
+        if (stats_file == NULL) {
+            fprintf(stderr, ERR_FOPEN_FAIL);
+            exit(fopen_fail);
+        }
+    }
+
+    fprintf(stats_file, "{\"engine\": \"%s\", \"hash\": \"%s\", "
+            "\"words\": %d, \"table_size\": %d, \"resizes\": %d, "
+            "\"resize_seconds\": %f, \"bytes_in_use\": %lu",
+            ENGINENAME, hashdata->hash_family->name, hashdata->word_count,
+            hashdata->table_size, hashdata->resize_count,
+            hashdata->resize_seconds, bytes_in_use);
+#ifdef TABLE_STATS
+    fprintf(stats_file, ", \"bytes_allocated\": %lu",\
+            hashdata->stats->bytes_allocated);
+    PrintHistogram(stats_file, "insert_probes",\
+                   hashdata->stats->insert_probes, STATSPROBES);
+    PrintHistogram(stats_file, "hit_probes", hashdata->stats->hit_probes,\
+                   STATSPROBES);
+    PrintHistogram(stats_file, "miss_probes", hashdata->stats->miss_probes,\
+                   STATSPROBES);
+#endif
+    PrintHistogram(stats_file, "chain_lengths", chains, STATSPROBES);
+    fprintf(stats_file, "}\n");
+
+    if (stats_file != stdout && fclose(stats_file) != 0) {
+        fprintf(stderr, ERR_FCLOSE_FAIL);
+        exit(fclose_fail);
+    }
+}
+
+/* Counts the buckets by the length of their chain, the last entry also
+ * counting every longer chain */
+void ChainLengths(HashData *hashdata, unsigned long *chains)
+{
+    HashElem *elems = hashdata->pool.elems;
+    unsigned int elem;
+    int i, length;
+
+    memset(chains, 0, STATSPROBES * sizeof(unsigned long));
+    for (i = 0; i < hashdata->table_size; i++) {
+        length = 0;
+        for (elem = hashdata->hash_table[i]; elem != ENDOFCHAIN;
+             elem = elems[elem].next) {
+            length++;
+        }
+        chains[length < STATSPROBES ? length : STATSPROBES - 1]++;
+    }
+}
+
+/* Prints a histogram as a named JSON array, dropping the empty buckets
+ * after the last filled one */
+void PrintHistogram(FILE *stats_file, char *name, unsigned long *counts,
+                    int num_counts)
+{
+    int i;
+
+    while (num_counts > 0 && counts[num_counts - 1] == 0) {
+        num_counts--;
+    }
+
+    fprintf(stats_file, ", \"%s\": [", name);
+    for (i = 0; i < num_counts; i++) {
+        fprintf(stats_file, i == 0 ? "%lu" : ", %lu", counts[i]);
+    }
+    fprintf(stats_file, "]");
+}
+
+#ifdef TABLE_STATS
+/* Adds one thread's counts into the table's */
+void MergeTableStats(TableStats *total, TableStats *stats)
+{
+    int i;
+
+    for (i = 0; i < STATSPROBES; i++) {
+        total->insert_probes[i] += stats->insert_probes[i];
+        total->hit_probes[i] += stats->hit_probes[i];
+        total->miss_probes[i] += stats->miss_probes[i];
+    }
+    total->bytes_allocated += stats->bytes_allocated;
+}
+#endif
@@ -2,14 +2,56 @@
 
 #define MAXWORDLEN 15
 #define MAXLOADFRACTION 0.6
-#define SIZEINCREASE 2
 #define PRIME 31
+#define LADDERSTEPS (int)(sizeof(PrimeLadder) / sizeof(PrimeLadder[0]))
+
+/* Each prime is the next prime >= twice the one before it, so growing the
+ * table steps up one rung instead of searching for primes at runtime.
+ * Multipliers are 2^64 / d + 1 for d = prime and d = prime - 1 */
+static const PrimeStep PrimeLadder[] = {
+    {         5, UINT64_C(0x3333333333333334), UINT64_C(0x4000000000000000)},
+    {        11, UINT64_C(0x1745D1745D1745D2), UINT64_C(0x199999999999999A)},
+    {        23, UINT64_C(0x0B21642C8590B217), UINT64_C(0x0BA2E8BA2E8BA2E9)},
+    {        53, UINT64_C(0x04D4873ECADE304E), UINT64_C(0x04EC4EC4EC4EC4ED)},
+    {       113, UINT64_C(0x0243F6F0243F6F03), UINT64_C(0x024924924924924A)},
+    {       251, UINT64_C(0x0105197F7D734042), UINT64_C(0x010624DD2F1A9FBF)},
+    {       503, UINT64_C(0x00824A4E60B3262C), UINT64_C(0x00828CBFBEB9A021)},
+    {      1009, UINT64_C(0x0040F391612C6681), UINT64_C(0x0041041041041042)},
+    {      2027, UINT64_C(0x002054DEC8CF1FB4), UINT64_C(0x002058F4A0B9FF7F)},
+    {      4057, UINT64_C(0x0010275FF9F13C03), UINT64_C(0x00102864FC7729E9)},
+    {      8117, UINT64_C(0x000812EC59F2D11B), UINT64_C(0x0008132D8C2CEAAE)},
+    {     16249, UINT64_C(0x00040881F21AB04C), UINT64_C(0x0004089236B43F06)},
+    {     32503, UINT64_C(0x0002042CA46C6871), UINT64_C(0x00020430B53899A0)},
+    {     65011, UINT64_C(0x000102113D5AD344), UINT64_C(0x0001021241829A5A)},
+    {    130027, UINT64_C(0x0000810759802C1B), UINT64_C(0x000081079A88B54B)},
+    {    260081, UINT64_C(0x00004081F5D2FFD7), UINT64_C(0x00004082061440D3)},
+    {    520193, UINT64_C(0x000020407CF1D40A), UINT64_C(0x0000204081020409)},
+    {   1040387, UINT64_C(0x000010203D74DE37), UINT64_C(0x000010203E78EA05)},
+    {   2080777, UINT64_C(0x000008101DF76660), UINT64_C(0x000008101E386945)},
+    {   4161557, UINT64_C(0x000004080ECAF108), UINT64_C(0x000004080EDB31BF)},
+    {   8323151, UINT64_C(0x0000020406CF2211), UINT64_C(0x0000020406D3323C)},
+    {  16646317, UINT64_C(0x0000010203585467), UINT64_C(0x0000010203595871)},
+    {  33292687, UINT64_C(0x00000081019EB4A7), UINT64_C(0x00000081019EF5A9)},
+    {  66585377, UINT64_C(0x0000004080CF2992), UINT64_C(0x0000004080CF39D2)},
+    { 133170769, UINT64_C(0x00000020406757D7), UINT64_C(0x0000002040675BE7)},
+    { 266341583, UINT64_C(0x0000001020337E36), UINT64_C(0x0000001020337F3A)},
+    { 532683227, UINT64_C(0x000000081019AF9D), UINT64_C(0x000000081019AFDE)},
+    {1065366479, UINT64_C(0x00000004080CD639), UINT64_C(0x00000004080CD649)},
+    {2130732959, UINT64_C(0x0000000204066B19), UINT64_C(0x0000000204066B1D)},
+};
 
 void InitialiseHashData(HData *hdata, int size)
 {
-    int prime_size = PrimeReturn(size);
+    NewHashTable(hdata, PrimeIndex(size));
+}
+
+/* Allocates an empty hash table of the ladder size */
+void NewHashTable(HData *hdata, int prime_index)
+{
+    int prime_size = PrimeLadder[prime_index].prime;
 
     hdata->hash_table = (char **)calloc(prime_size, sizeof(char *));
+    hdata->prime_index = prime_index;
     hdata->table_size = prime_size;
     hdata->max_table_load = (int)(prime_size * MAXLOADFRACTION);
 }
@@ -40,10 +82,16 @@ void CreateHashTable(HData *hdata, char *filename, SDL_Simplewin *sw)
         
         /* Update the SDL window each time a word is hashed */
         UpdateSDL(sw, &sdl_data, hdata, count);
+#ifndef HEADLESS
         SDL_Delay(DELAYMS);
+#endif
 
-        /* If the hash table is too full, rebuild with 2x size */
+        /* If the hash table is too full, rebuild with 2x size. Headless,
+         * the full table's heatmap is written out first */
         if (count > hdata->max_table_load) {
+#ifdef HEADLESS
+            WriteFrame(sw, &sdl_data, hdata, false);
+#endif
             ResetDisplay(sw, &sdl_data);
             ResizeHashTable(hdata, sw, &sdl_data);
         }
@@ -54,7 +102,8 @@ void CreateHashTable(HData *hdata, char *filename, SDL_Simplewin *sw)
         fprintf(stderr, ERR_FCLOSE_FAIL);
         exit(fclose_fail);
     }
-    EndSDL(sw, &sdl_data);
+    EndSDL(sw, &sdl_data, hdata);
+    free(sdl_data.d_array);
 }
 
 void InitialiseSDL(SDLData *sdl_data, int table_size) 
@@ -85,11 +134,15 @@ void ResetDisplay(SDL_Simplewin *sw, SDLData *sdl_data)
 {
     int i;
     
+#ifdef HEADLESS
+    (void)sw;
+#else
     /* Reset the display to black, and draw the progress bar outline */
     Neill_SDL_SetDrawColour(sw, 0, 0, 0);
     SDL_RenderFillRect(sw->renderer, &sdl_data->clear_screen);
     Neill_SDL_SetDrawColour(sw, COLOURMAX, COLOURMAX, COLOURMAX);
     SDL_RenderDrawRect(sw->renderer, &sdl_data->bar_outline);
+#endif
     
     for (i = 0; i < WWIDTH; i++) {
         sdl_data->d_array[i] = 0.0;
@@ -104,7 +157,11 @@ void UpdateSDL(SDL_Simplewin *sw, SDLData *sdl_data, HData *hdata, int count)
     sdl_data->d_array[sdl_data->array_loc] += sdl_data->col_increment;
     sdl_data->prog_bar_val = (double)count/(hdata->max_table_load)*PROGBARMAX;
     sdl_data->pixel_line.x = sdl_data->array_loc;
-    
+
+#ifdef HEADLESS
+    /* Only the heatmap is kept, frames are drawn from it when written */
+    (void)sw;
+#else
     /* Update the colour of the relevant hash table cell */
     Neill_SDL_SetDrawColour(sw, sdl_data->d_array[sdl_data->array_loc], 0, 0);
     SDL_RenderFillRect(sw->renderer, &sdl_data->pixel_line);
@@ -124,11 +181,18 @@ void UpdateSDL(SDL_Simplewin *sw, SDLData *sdl_data, HData *hdata, int count)
         atexit(SDL_Quit);
         exit(0);
     }
+#endif
  }
 
 /* Turn the progress bar green to indicate hashing has finished */
-void EndSDL(SDL_Simplewin *sw, SDLData *sdl_data) 
+void EndSDL(SDL_Simplewin *sw, SDLData *sdl_data, HData *hdata) 
 {
+#ifdef HEADLESS
+    /* The finished table is the last frame */
+    WriteFrame(sw, sdl_data, hdata, true);
+#else
+    (void)hdata;
+
     /* Draw progress bar in green if hashing has completed */
     Neill_SDL_SetDrawColour(sw, 0, COLOURMAX, 0);
     sdl_data->prog_bar.w = sdl_data->prog_bar_val;
@@ -144,6 +208,7 @@ void EndSDL(SDL_Simplewin *sw, SDLData *sdl_data)
         atexit(SDL_Quit);
         exit(0);
     }
+#endif
 }
 
 /* Copies the next word from file into the curr_word string */
@@ -169,11 +234,13 @@ void LoadNextWord(char *curr_word, FILE *txt_file)
 /* Finds a hash for the current word, then places it in the hash table */
 int AddToHashTable(HData *hdata, char *curr_word)
 {
+    const PrimeStep *step = &PrimeLadder[hdata->prime_index];
     int hash1, hash2, hash_t;
 
     /* Calculate the hashes for the current word */
-    hash1 = HashFunc1(curr_word) % hdata->table_size;
-    hash2 = (HashFunc2(curr_word) % (hdata->table_size - 1)) + 1;
+    hash1 = FastMod(HashFunc1(curr_word), step->mod_mult, step->prime);
+    hash2 = FastMod(HashFunc2(curr_word), step->step_mod_mult,\
+                    step->prime - 1) + 1;
     hash_t = hash1;
     
     /* Loop taking hash2 away from hash_t until an empty space is found */
@@ -210,7 +277,8 @@ unsigned int HashFunc1(char *str)
     c1 = str[0];
     c2 = str[1];
     cn1 = str[n - 1];
-    cn2 = str[n - 2];
+    /* A one letter word has no second last char, don't read before it */
+    cn2 = n > 1 ? str[n - 2] : 0;
 
     hash = (c1*c2 + cn1*cn2) * n;
 
@@ -238,8 +306,12 @@ void ResizeHashTable(HData *hdata, SDL_Simplewin *sw, SDLData *sdl_data)
     int old_table_size = hdata->table_size;
     int i, count = 0;
     
-    /* Create the new bigger hash table, currently empty */
-    InitialiseHashData(hdata, PrimeReturn(hdata->table_size * SIZEINCREASE));
+    if (hdata->prime_index + 1 >= LADDERSTEPS) {
+        fprintf(stderr, ERR_TABLE_MAX);
+        exit(hash_table_full);
+    }
+    /* Create the new bigger hash table on the next rung, currently empty */
+    NewHashTable(hdata, hdata->prime_index + 1);
     
     /* Update the SDL variables based on the new table size */
 	sdl_data->cells_per_pix = (int)ceil((double)hdata->table_size / WWIDTH);
@@ -253,24 +325,37 @@ void ResizeHashTable(HData *hdata, SDL_Simplewin *sw, SDLData *sdl_data)
             /* Add the new word to the hash table and update the SDL window */
             sdl_data->hash = AddToHashTable(hdata, old_hash_table[i]);
             UpdateSDL(sw, sdl_data, hdata, count);
+#ifndef HEADLESS
 			SDL_Delay(DELAYMS);
+#endif
         }
     }
     FreeHashTable(old_hash_table, old_table_size);
 }
 
-int PrimeReturn(int test)
+/* From a given input integer, find the first ladder prime at least as big */
+int PrimeIndex(int size)
 {
     int i;
 
-    for (i = 2; i < test / 2; i++) {
-        if (test % i == 0) {
-            i = 1;
-            test++;
+    for (i = 0; i < LADDERSTEPS; i++) {
+        if (PrimeLadder[i].prime >= (unsigned int)size) {
+            return i;
         }
     }
 
-    return test;
+    fprintf(stderr, ERR_TABLE_MAX);
+    exit(hash_table_full);
+}
+
+/* Lemire's fastmod, a % d from the ladder multiplier with no division. The
+ * high half of the 64 x 32 bit product is built from 32 bit halves */
+unsigned int FastMod(unsigned int a, uint64_t mod_mult, unsigned int d)
+{
+    uint64_t low_bits = mod_mult * a;
+
+    return (unsigned int)((((low_bits >> 32) * d) +
+                           (((low_bits & 0xFFFFFFFFu) * d) >> 32)) >> 32);
 }
 
 /* Loops to first free each word in the table, the frees the hash table */
@@ -2,7 +2,12 @@
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdint.h>
+#ifdef HEADLESS
+#include "headless.h"
+#else
 #include "neillsdl2.h"
+#endif
 
 /* Error Print Statements */
 #define ERR_NO_FILE      "ERROR - 1 filename need to be passed to the program.\n"
@@ -12,6 +17,8 @@
 #define ERR_WORD_MISSING "ERROR - A word was not found in the hash table.\n"
 #define ERR_EMPTY_FILE   "ERROR - No words were found in the test search file.\n"
 #define ERR_LONG_STR     "ERROR - A word in the dictionary > MAXWORDLEN.\n"
+#define ERR_TABLE_MAX    "ERROR - Hash table cannot grow past the largest prime.\n"
+#define ERR_FRAME_WRITE  "ERROR - Failed to write a heatmap frame.\n"
 
 /* SDL Parameters */
 #define COLOURMAX 255
@@ -26,8 +33,17 @@
 #define PROGBAR_H 100
 #define PROGBAR_Y 475
 
+/* A table size on the growth ladder, with the fastmod multipliers needed to
+ * reduce a hash modulo prime and modulo prime - 1 without dividing */
+typedef struct PrimeLadderStep {
+    unsigned int prime;
+    uint64_t mod_mult;
+    uint64_t step_mod_mult;
+} PrimeStep;
+
 typedef struct HashTableData {
 	char **hash_table;
+	int prime_index;
 	int table_size;
 	int max_table_load;
 } HData;
@@ -53,7 +69,8 @@ enum Exit_Codes {
 	hash_table_full = 8,
 	word_not_found = 9,
 	search_file_empty = 10,
-	str_too_long = 11
+	str_too_long = 11,
+	frame_write_fail = 12
 };
 
 enum Boolean {
@@ -63,16 +80,25 @@ enum Boolean {
 
 /* Hashing Functions */
 void InitialiseHashData(HData *hdata, int size);
+void NewHashTable(HData *hdata, int prime_index);
 void CreateHashTable(HData *hdata, char *filename, SDL_Simplewin *sw);
 void LoadNextWord(char *curr_word, FILE *txt_file);
 int AddToHashTable(HData *hdata, char *curr_word);
 unsigned int HashFunc1(char *str);
 unsigned int HashFunc2(char *str);
 void ResizeHashTable(HData *hdata, SDL_Simplewin *sw, SDLData *sdl_data);
-int PrimeReturn(int test);
+int PrimeIndex(int size);
+unsigned int FastMod(unsigned int a, uint64_t mod_mult, unsigned int d);
 void FreeHashTable(char **hash_table, int table_size);
 /* SDL Functions */
 void ResetDisplay(SDL_Simplewin *sw, SDLData *sdl_data);
 void UpdateSDL(SDL_Simplewin *sw, SDLData *sdl_data, HData *hdata, int count);
-void EndSDL(SDL_Simplewin *sw, SDLData *sdl_data); 
+void EndSDL(SDL_Simplewin *sw, SDLData *sdl_data, HData *hdata);
 void InitialiseSDL(SDLData *sdl_data, int table_size);
+#ifdef HEADLESS
+/* Headless frames, headless.c */
+void WriteFrame(SDL_Simplewin *sw, SDLData *sdl_data, HData *hdata,
+                int finished);
+void FillFrameRect(unsigned char *pixels, SDL_Rect *rect, int r, int g,
+                   int b);
+#endif
@@ -8,6 +8,17 @@ int main(int argc, char **argv)
 	SDL_Simplewin sw;
 	InitialiseHashData(&hdata, STARTSIZE);
 
+#ifdef HEADLESS
+	/* Exit if not passed a dictionary, frames are named from the prefix
+	 * given after it if any */
+	if (argc != 2 && argc != 3) {
+		fprintf(stderr, ERR_NO_FILE);
+		exit(no_file_passed);
+	}
+	sw.finished = false;
+	sw.frame_prefix = argc == 3 ? argv[2] : FRAMEPREFIX;
+	sw.frame_count = 0;
+#else
 	Neill_SDL_Init(&sw);	
 
 	/* Exit if not passed a dictionary */
@@ -15,13 +26,18 @@ int main(int argc, char **argv)
 		fprintf(stderr, ERR_NO_FILE);
 		exit(no_file_passed);
 	}
+#endif
 
 	/* Set up the hash table for the given dictionary file */
 	CreateHashTable(&hdata, argv[1], &sw);
     
     /* Free up all dynamically allocated space used in the hash table */
 	FreeHashTable(hdata.hash_table, hdata.table_size);
-    
+
+#ifdef HEADLESS
+	/* Every frame has been written, there is no window to wait on */
+	return 0;
+#else
 	/* Wait until the user presses esc or closes the SDL window */
 	while(!sw.finished) {
 		Neill_SDL_Events(&sw);
@@ -31,4 +47,5 @@ int main(int argc, char **argv)
    	atexit(SDL_Quit);
 
 	return 0;
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,84 @@
+#include "dhash.h"
+
+/* Draws the heatmap as the window would show it, each column's red from its
+ * share of filled cells, under the progress bar, blue while filling & green
+ * once finished. Written as a binary PPM, the next numbered frame */
+void WriteFrame(SDL_Simplewin *sw, SDLData *sdl_data, HData *hdata,
+                int finished)
+{
+    unsigned char *pixels;
+    char *frame_name;
+    FILE *frame_file;
+    SDL_Rect outline;
+    double red;
+    int i;
+
+    pixels = calloc(WWIDTH * WHEIGHT * 3, 1);
+    frame_name = malloc(strlen(sw->frame_prefix) + FRAMESUFFIXLEN);
+    if (pixels == NULL || frame_name == NULL) {
+        fprintf(stderr, ERR_FRAME_WRITE);
+        exit(frame_write_fail);
+    }
+
+    for (i = 0; i < WWIDTH; i++) {
+        red = sdl_data->d_array[i] < COLOURMAX ?\
+            sdl_data->d_array[i] : COLOURMAX;
+        sdl_data->pixel_line.x = i;
+        FillFrameRect(pixels, &sdl_data->pixel_line, (int)red, 0, 0);
+    }
+
+    /* The outline is one pixel wide, so is drawn as its four edges */
+    outline = sdl_data->bar_outline;
+    outline.h = 1;
+    FillFrameRect(pixels, &outline, COLOURMAX, COLOURMAX, COLOURMAX);
+    outline.y += sdl_data->bar_outline.h - 1;
+    FillFrameRect(pixels, &outline, COLOURMAX, COLOURMAX, COLOURMAX);
+    outline = sdl_data->bar_outline;
+    outline.w = 1;
+    FillFrameRect(pixels, &outline, COLOURMAX, COLOURMAX, COLOURMAX);
+    outline.x += sdl_data->bar_outline.w - 1;
+    FillFrameRect(pixels, &outline, COLOURMAX, COLOURMAX, COLOURMAX);
+
+    sdl_data->prog_bar.w = sdl_data->prog_bar_val;
+    FillFrameRect(pixels, &sdl_data->prog_bar, 0,\
+                  finished ? COLOURMAX : 0, finished ? 0 : COLOURMAX);
+
+    sw->frame_count++;
+    sprintf(frame_name, "%s-%03d.ppm", sw->frame_prefix, sw->frame_count);
+    frame_file = fopen(frame_name, "wb");
+    if (frame_file == NULL) {
+        fprintf(stderr, ERR_FOPEN_FAIL);
+        exit(fopen_fail);
+    }
+    fprintf(frame_file, "P6\n%d %d\n%d\n", WWIDTH, WHEIGHT, COLOURMAX);
+    if (fwrite(pixels, 1, WWIDTH * WHEIGHT * 3, frame_file) !=
+        WWIDTH * WHEIGHT * 3 || fclose(frame_file) != 0) {
+        fprintf(stderr, ERR_FRAME_WRITE);
+        exit(frame_write_fail);
+    }
+    free(pixels);
+
+    printf("%s: table size %d%s\n", frame_name, hdata->table_size,
+           finished ? ", finished" : "");
+    free(frame_name);
+}
+
+/* Fills a rectangle of a WWIDTH x WHEIGHT RGB image, clipped to the image */
+void FillFrameRect(unsigned char *pixels, SDL_Rect *rect, int r, int g,
+                   int b)
+{
+    unsigned char *pixel;
+    int x, y;
+
+    for (y = rect->y; y < rect->y + rect->h; y++) {
+        for (x = rect->x; x < rect->x + rect->w; x++) {
+            if (x < 0 || x >= WWIDTH || y < 0 || y >= WHEIGHT) {
+                continue;
+            }
+            pixel = pixels + (y * WWIDTH + x) * 3;
+            pixel[0] = (unsigned char)r;
+            pixel[1] = (unsigned char)g;
+            pixel[2] = (unsigned char)b;
+        }
+    }
+}
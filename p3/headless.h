@@ -0,0 +1,22 @@
+#include <math.h>
+
+/* Built with -DHEADLESS there is no SDL, nothing is drawn & there is no
+ * delay. These stand in for SDL's types, the window instead writing each
+ * frame of the same layout out as a PPM image */
+#define WWIDTH 800
+#define WHEIGHT 600
+#define FRAMEPREFIX "heatmap"
+/* Room for the frame number, .ppm & the terminator after the prefix */
+#define FRAMESUFFIXLEN 24
+
+typedef struct HeadlessRect {
+    int x, y;
+    int w, h;
+} SDL_Rect;
+
+/* Frames are written to frame_prefix-NNN.ppm, numbered from 1 */
+typedef struct HeadlessWin {
+    int finished;
+    char *frame_prefix;
+    int frame_count;
+} SDL_Simplewin;
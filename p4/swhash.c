@@ -0,0 +1,445 @@
+#include "swhash.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define PRIME 31
+
+void InitHashData(HashData *hashdata, int size)
+{
+    /* Start with an empty string arena, words are bump allocated into it */
+    hashdata->arena.text = malloc(ARENASTARTSIZE);
+    if (hashdata->arena.text == NULL) {
+        fprintf(stderr, ERR_NO_MEMORY);
+        exit(out_of_memory);
+    }
+    hashdata->arena.used = 0;
+    hashdata->arena.size = ARENASTARTSIZE;
+    hashdata->arena.mapped = false;
+    hashdata->word_count = 0;
+    hashdata->hash_family = &HashFamilies[0];
+    hashdata->hash_seed = DEFAULTSEED;
+    hashdata->resize_count = 0;
+    hashdata->resize_seconds = 0;
+    hashdata->presize = false;
+    hashdata->batch_lookups = false;
+    hashdata->num_threads = 1;
+    hashdata->perf_counters = false;
+
+    NewHashTable(hashdata, TableSize(size));
+}
+
+/* Allocates an empty table of table_size slots, a power of two, leaving the
+ * arena alone */
+void NewHashTable(HashData *hashdata, int table_size)
+{
+    hashdata->ctrl = (signed char *)malloc(table_size);
+    hashdata->slots = (HashSlot *)malloc(table_size * sizeof(HashSlot));
+    if (hashdata->ctrl == NULL || hashdata->slots == NULL) {
+        fprintf(stderr, ERR_NO_MEMORY);
+        exit(out_of_memory);
+    }
+    memset(hashdata->ctrl, CTRLEMPTY, table_size);
+    hashdata->table_size = table_size;
+    hashdata->group_mask = table_size / GROUPWIDTH - 1;
+    hashdata->max_table_load = (int)(table_size * MAXLOADFRACTION);
+    hashdata->deleted_count = 0;
+}
+
+/* Reads the dictionary into the table, each word placed as it is read */
+void CreateHashTable(HashData *hashdata, char *filename)
+{
+    ReadDictionary(hashdata, filename);
+}
+
+/* Places a word that is already in the arena into the hash table, growing
+ * the table first if it is at its load limit. Duplicates are kept, so it
+ * always returns true */
+int AddArenaWord(HashData *hashdata, unsigned int offset)
+{
+    HashSlot slot;
+
+    if (hashdata->word_count + hashdata->deleted_count >=\
+        hashdata->max_table_load) {
+        ResizeHashTable(hashdata);
+    }
+
+    /* Hash the word once, the slot keeps the hash from then on */
+    slot.word = offset;
+    slot.hash = TableHash(hashdata->hash_family->hash(\
+        hashdata->arena.text + offset, hashdata->hash_seed));
+    InsertSlot(hashdata, &slot);
+    hashdata->word_count++;
+    return true;
+}
+
+/* Places a slot in the first empty or deleted slot along its probe
+ * sequence. Groups are visited at triangular number steps, which reaches
+ * every group of a power of two table */
+void InsertSlot(HashData *hashdata, HashSlot *slot)
+{
+    unsigned int group = slot->hash & hashdata->group_mask;
+    unsigned int step, mask, pos;
+
+    for (step = 1; step <= hashdata->group_mask + 1; step++) {
+        mask = GroupMatchFree(hashdata->ctrl + group * GROUPWIDTH);
+        if (mask != 0) {
+            pos = group * GROUPWIDTH + LOWESTBIT(mask);
+            if (hashdata->ctrl[pos] == CTRLDELETED) {
+                hashdata->deleted_count--;
+            }
+            hashdata->ctrl[pos] = (signed char)(slot->hash >> TAGSHIFT);
+            hashdata->slots[pos] = *slot;
+            return;
+        }
+        group = (group + step) & hashdata->group_mask;
+    }
+
+    fprintf(stderr, ERR_TABLE_FULL);
+    exit(hash_table_full);
+}
+
+/* Folds a family's 64 bit hash to the 32 bits the table keeps. The low bits
+ * pick the group, the top 7 are the tag */
+unsigned int TableHash(uint64_t full_hash)
+{
+    return (unsigned int)(full_hash ^ (full_hash >> 32));
+}
+
+/* Bit i set for each slot i of the group whose control byte is tag */
+unsigned int GroupMatch(signed char *group, int tag)
+{
+#ifdef __SSE2__
+    __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+
+    return (unsigned int)_mm_movemask_epi8(\
+        _mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)tag)));
+#else
+    unsigned int mask = 0;
+    int i;
+
+    for (i = 0; i < GROUPWIDTH; i++) {
+        if (group[i] == tag) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+#endif
+}
+
+/* Bit i set for each empty slot i of the group */
+unsigned int GroupMatchEmpty(signed char *group)
+{
+    return GroupMatch(group, CTRLEMPTY);
+}
+
+/* Bit i set for each empty or deleted slot i, the only control bytes with
+ * the top bit set, so SSE2 needs just the movemask */
+unsigned int GroupMatchFree(signed char *group)
+{
+#ifdef __SSE2__
+    return (unsigned int)_mm_movemask_epi8(\
+        _mm_loadu_si128((const __m128i *)group));
+#else
+    unsigned int mask = 0;
+    int i;
+
+    for (i = 0; i < GROUPWIDTH; i++) {
+        if (group[i] < 0) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+#endif
+}
+
+/* Index of the lowest set bit of a non zero mask, for compilers without a
+ * count trailing zeros builtin */
+int LowestBit(unsigned int mask)
+{
+    int i = 0;
+
+    while ((mask & 1u) == 0) {
+        mask >>= 1;
+        i++;
+    }
+    return i;
+}
+
+/* Calculates a hash using each char & string length */
+unsigned int HashFunc(char *str)
+{
+    int i;
+    int n = strlen(str);
+    unsigned int hash = 0;
+
+    for (i = 0; i < n; i++) {
+        hash = str[i] + PRIME * hash;
+    }
+
+    return hash;
+}
+
+/* The original hash as a family. Power of two sizes only use some of the
+ * bits, so it is put through murmur3's 64 bit finaliser first. Unseeded */
+uint64_t HashClassic(char *str, uint64_t seed)
+{
+    uint64_t hash = HashFunc(str);
+
+    (void)seed;
+    hash ^= hash >> 33;
+    hash *= UINT64_C(0xFF51AFD7ED558CCD);
+    hash ^= hash >> 33;
+    hash *= UINT64_C(0xC4CEB9FE1A85EC53);
+    hash ^= hash >> 33;
+    return hash;
+}
+
+/* Doubles the table, or rehashes at the same size when deleted slots
+ * rather than words have filled it */
+void ResizeHashTable(HashData *hashdata)
+{
+    if (hashdata->word_count <= hashdata->max_table_load / 2) {
+        RehashTable(hashdata, hashdata->table_size);
+    }
+    else {
+        RehashTable(hashdata, hashdata->table_size * 2);
+    }
+}
+
+/* Creates a new table of table_size slots & moves every full slot of the
+ * old one into it by its stored hash, dropping deleted slots */
+void RehashTable(HashData *hashdata, int table_size)
+{
+    signed char *old_ctrl = hashdata->ctrl;
+    HashSlot *old_slots = hashdata->slots;
+    int i, old_table_size = hashdata->table_size;
+    double start = WallSeconds();
+
+    if (table_size > MAXTABLESIZE) {
+        fprintf(stderr, ERR_TABLE_MAX);
+        exit(hash_table_full);
+    }
+    NewHashTable(hashdata, table_size);
+
+    for (i = 0; i < old_table_size; i++) {
+        if (old_ctrl[i] >= 0) {
+            InsertSlot(hashdata, &old_slots[i]);
+        }
+    }
+    free(old_ctrl);
+    free(old_slots);
+
+    hashdata->resize_count++;
+    hashdata->resize_seconds += WallSeconds() - start;
+}
+
+/* Grows the table once, straight to a size that holds capacity words
+ * without any further resizes. A table that is already big enough is kept */
+void ReserveCapacity(HashData *hashdata, long capacity)
+{
+    int table_size = CapacitySize(capacity);
+
+    if (table_size <= hashdata->table_size) {
+        return;
+    }
+
+    /* An empty table has nothing to move, so is simply replaced */
+    if (hashdata->word_count == 0) {
+        free(hashdata->ctrl);
+        free(hashdata->slots);
+        NewHashTable(hashdata, table_size);
+    }
+    else {
+        RehashTable(hashdata, table_size);
+    }
+}
+
+/* The smallest table size whose maximum load is above capacity, since a
+ * table is grown on reaching its maximum load */
+int CapacitySize(long capacity)
+{
+    long table_size = MINTABLESIZE;
+
+    while ((long)(table_size * MAXLOADFRACTION) <= capacity) {
+        table_size *= 2;
+        if (table_size > MAXTABLESIZE) {
+            fprintf(stderr, ERR_TABLE_MAX);
+            exit(hash_table_full);
+        }
+    }
+    return (int)table_size;
+}
+
+/* The smallest power of two table size of at least size slots */
+int TableSize(long size)
+{
+    long table_size = MINTABLESIZE;
+
+    while (table_size < size) {
+        table_size *= 2;
+        if (table_size > MAXTABLESIZE) {
+            fprintf(stderr, ERR_TABLE_MAX);
+            exit(hash_table_full);
+        }
+    }
+    return (int)table_size;
+}
+
+/* Removes a word from the table, returning false if it was not there. Its
+ * slot becomes empty if its group has an empty slot, as no probe passes
+ * through such a group, otherwise it is marked deleted */
+int DeleteWord(HashData *hashdata, char *curr_word)
+{
+    unsigned int hash = TableHash(\
+        hashdata->hash_family->hash(curr_word, hashdata->hash_seed));
+    int counter = 0;
+    int pos = FindSlot(hashdata, curr_word, hash, &counter);
+
+    if (pos == NOTFOUND) {
+        return false;
+    }
+
+    if (GroupMatchEmpty(hashdata->ctrl + pos / GROUPWIDTH * GROUPWIDTH)) {
+        hashdata->ctrl[pos] = CTRLEMPTY;
+    }
+    else {
+        hashdata->ctrl[pos] = CTRLDELETED;
+        hashdata->deleted_count++;
+    }
+    hashdata->word_count--;
+    return true;
+}
+
+/* Deletes every word of a file from the table, returning how many were in it */
+int DeleteFileWords(HashData *hashdata, char *filename)
+{
+    char curr_word[MAXWORDLEN];
+    int deleted = 0;
+    FILE *txt_file = fopen(filename, "r");
+
+    if (txt_file == NULL) {
+        fprintf(stderr, ERR_FOPEN_FAIL);
+        exit(fopen_fail);
+    }
+
+    LoadNextWord(curr_word, txt_file);
+    while (curr_word[0] != '\0') {
+        deleted += DeleteWord(hashdata, curr_word);
+        LoadNextWord(curr_word, txt_file);
+    }
+
+    if (fclose(txt_file) != 0) {
+        fprintf(stderr, ERR_FCLOSE_FAIL);
+        exit(fclose_fail);
+    }
+    return deleted;
+}
+
+/* Frees the control bytes & slots, then every word at once with the arena */
+void FreeHashTable(HashData *hashdata)
+{
+    free(hashdata->ctrl);
+    free(hashdata->slots);
+
+    if (hashdata->arena.mapped) {
+        munmap(hashdata->arena.text, hashdata->arena.used);
+    }
+    else {
+        free(hashdata->arena.text);
+    }
+}
+
+/* p4 adds nothing to the driver's own report */
+void ReportTable(HashData *hashdata)
+{
+    (void)hashdata;
+}
+
+/* Nor to the benchmark's JSON */
+void ReportTableJson(HashData *hashdata)
+{
+    (void)hashdata;
+}
+
+/* Returns the groups probed to find the word, or NOTFOUND. The table is only
+ * read, so several threads may search it at once */
+int FindWord(HashData *hashdata, char *curr_word)
+{
+    unsigned int hash = TableHash(\
+        hashdata->hash_family->hash(curr_word, hashdata->hash_seed));
+    int counter = 0;
+
+    if (FindSlot(hashdata, curr_word, hash, &counter) == NOTFOUND) {
+        return NOTFOUND;
+    }
+    return counter;
+}
+
+/* Returns the word's slot, or NOTFOUND, adding each group probed to counter.
+ * Each group's control bytes are matched against the tag at once, so only
+ * slots with the right tag & hash are compared with the word */
+int FindSlot(HashData *hashdata, char *curr_word, unsigned int hash,
+             int *counter)
+{
+    unsigned int group = hash & hashdata->group_mask;
+    unsigned int step, mask, pos;
+    signed char *ctrl;
+    int tag = (signed char)(hash >> TAGSHIFT);
+
+    for (step = 1; step <= hashdata->group_mask + 1; step++) {
+        (*counter)++;
+        ctrl = hashdata->ctrl + group * GROUPWIDTH;
+
+        for (mask = GroupMatch(ctrl, tag); mask != 0; mask &= mask - 1) {
+            pos = group * GROUPWIDTH + LOWESTBIT(mask);
+            if (hashdata->slots[pos].hash == hash &&
+                strcmp(hashdata->arena.text + hashdata->slots[pos].word,\
+                       curr_word) == 0) {
+                return (int)pos;
+            }
+        }
+
+        /* An empty slot ends the probe, the word would have been put there */
+        if (GroupMatchEmpty(ctrl) != 0) {
+            return NOTFOUND;
+        }
+        group = (group + step) & hashdata->group_mask;
+    }
+
+    return NOTFOUND;
+}
+
+/* Returns the total groups probed to find the batch, or NOTFOUND if any of
+ * its words is missing. All the hashes are computed and first groups
+ * prefetched up front, so the words' cache misses overlap before each is
+ * probed in turn. Only reads the table */
+int FindWordBatch(HashData *hashdata, char **words, int num_words)
+{
+    uint64_t full_hashes[BATCHSIZE];
+    unsigned int hashes[BATCHSIZE];
+    unsigned int group;
+    int i, total_lookups = 0;
+
+    /* Hash the whole batch together, which may use the vector path */
+    hashdata->hash_family->hash_batch(hashdata->hash_family, words,\
+                                      num_words, hashdata->hash_seed,\
+                                      full_hashes);
+
+    for (i = 0; i < num_words; i++) {
+        hashes[i] = TableHash(full_hashes[i]);
+        group = hashes[i] & hashdata->group_mask;
+        PREFETCH(hashdata->ctrl + group * GROUPWIDTH);
+        PREFETCH(hashdata->slots + group * GROUPWIDTH);
+    }
+
+    for (i = 0; i < num_words; i++) {
+        if (FindSlot(hashdata, words[i], hashes[i], &total_lookups) ==\
+            NOTFOUND) {
+            return NOTFOUND;
+        }
+    }
+
+    return total_lookups;
+}
@@ -0,0 +1,76 @@
+#include "spll.h"
+
+#define MAXLOADFRACTION 0.875
+#define GROUPWIDTH 16
+#define MINTABLESIZE GROUPWIDTH
+#define MAXTABLESIZE (1 << 29)
+#define TAGSHIFT 25
+#define CTRLEMPTY (-128)
+#define CTRLDELETED (-2)
+#define ENGINENAME "p4"
+/* Words can be taken out, so the driver offers -delete */
+#define ENGINEDELETES
+
+/* Index of the lowest set bit of a non zero group mask */
+#ifdef __GNUC__
+#define LOWESTBIT(mask) __builtin_ctz(mask)
+#else
+#define LOWESTBIT(mask) LowestBit(mask)
+#endif
+
+/* Error Print Statements */
+#define ERR_TABLE_FULL   "ERROR - Hash table has not been resized correctly.\n"
+#define ERR_TABLE_MAX    "ERROR - Hash table cannot grow past MAXTABLESIZE.\n"
+
+/* A table slot, the word's arena offset & its 32 bit hash. The hash gives
+ * both the slot's group & its control byte tag, so resizing never rehashes
+ * the word */
+typedef struct HashTableSlot {
+    unsigned int word;
+    unsigned int hash;
+} HashSlot;
+
+/* Open addressing over groups of GROUPWIDTH slots. Each slot has a control
+ * byte, CTRLEMPTY, CTRLDELETED or the top 7 bits of its word's hash, so a
+ * whole group is matched against a word's tag at once */
+struct HashTableData {
+    signed char *ctrl;
+    HashSlot *slots;
+    int table_size;
+    unsigned int group_mask;
+    int max_table_load;
+    int word_count;
+    int deleted_count;
+    StrArena arena;
+    /* Hash function chosen at startup, and its seed */
+    const HashFamily *hash_family;
+    uint64_t hash_seed;
+    /* Resizes so far & the wall clock time spent in them */
+    int resize_count;
+    double resize_seconds;
+    /* Count the dictionary's lines first & size the table for them once */
+    int presize;
+    /* Look words up BATCHSIZE at a time in HashSearchTest */
+    int batch_lookups;
+    /* Split HashSearchTest over this many threads when more than 1 */
+    int num_threads;
+    /* Count hardware events around the benchmark's build & search */
+    int perf_counters;
+};
+
+void NewHashTable(HashData *hashdata, int table_size);
+void InsertSlot(HashData *hashdata, HashSlot *slot);
+unsigned int TableHash(uint64_t full_hash);
+unsigned int GroupMatch(signed char *group, int tag);
+unsigned int GroupMatchEmpty(signed char *group);
+unsigned int GroupMatchFree(signed char *group);
+int LowestBit(unsigned int mask);
+unsigned int HashFunc(char *str);
+void ResizeHashTable(HashData *hashdata);
+void RehashTable(HashData *hashdata, int table_size);
+int CapacitySize(long capacity);
+int TableSize(long size);
+int DeleteWord(HashData *hashdata, char *curr_word);
+int DeleteFileWords(HashData *hashdata, char *filename);
+int FindSlot(HashData *hashdata, char *curr_word, unsigned int hash,
+             int *counter);
@@ -0,0 +1,482 @@
+#include "chash.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define PRIME 31
+
+void InitHashData(HashData *hashdata, int size)
+{
+    /* Start with an empty string arena, words are bump allocated into it */
+    hashdata->arena.text = malloc(ARENASTARTSIZE);
+    if (hashdata->arena.text == NULL) {
+        fprintf(stderr, ERR_NO_MEMORY);
+        exit(out_of_memory);
+    }
+    hashdata->arena.used = 0;
+    hashdata->arena.size = ARENASTARTSIZE;
+    hashdata->arena.mapped = false;
+    hashdata->word_count = 0;
+    hashdata->kick_state = KICKSEED;
+    hashdata->hash_family = &HashFamilies[0];
+    hashdata->hash_seed = DEFAULTSEED;
+    hashdata->resize_count = 0;
+    hashdata->resize_seconds = 0;
+    hashdata->presize = false;
+    hashdata->batch_lookups = false;
+    hashdata->num_threads = 1;
+    hashdata->perf_counters = false;
+
+    NewHashTable(hashdata, BucketCount(size));
+}
+
+/* Allocates an empty table of num_buckets buckets, a power of two, each on
+ * its own cache line. Leaves the arena alone */
+void NewHashTable(HashData *hashdata, int num_buckets)
+{
+    void *buckets;
+
+    if (posix_memalign(&buckets, BUCKETALIGN,\
+                       num_buckets * sizeof(HashBucket)) != 0) {
+        fprintf(stderr, ERR_NO_MEMORY);
+        exit(out_of_memory);
+    }
+    /* Every byte 0xFF marks every slot as empty */
+    memset(buckets, 0xFF, num_buckets * sizeof(HashBucket));
+    hashdata->buckets = (HashBucket *)buckets;
+    hashdata->bucket_mask = num_buckets - 1;
+    hashdata->table_size = num_buckets * BUCKETSLOTS;
+    hashdata->max_table_load = (int)(hashdata->table_size * MAXLOADFRACTION);
+    hashdata->stash_count = 0;
+}
+
+/* Reads the dictionary into the table, each word placed as it is read */
+void CreateHashTable(HashData *hashdata, char *filename)
+{
+    ReadDictionary(hashdata, filename);
+}
+
+/* Places a word that is already in the arena into the hash table, growing
+ * the table first if it is at its load limit. A word already in the table
+ * is skipped & false returned, since no table could place more copies of
+ * one word than its two buckets & the stash hold */
+int AddArenaWord(HashData *hashdata, unsigned int offset)
+{
+    HashSlot slot;
+    uint64_t full_hash;
+    int counter = 0;
+
+    /* Hash the word once, the slot keeps both hashes from then on */
+    full_hash = hashdata->hash_family->hash(hashdata->arena.text + offset,\
+                                            hashdata->hash_seed);
+    slot.word = offset;
+    slot.hash1 = (unsigned int)full_hash;
+    slot.hash2 = (unsigned int)(full_hash >> 32);
+    if (FindSlot(hashdata, hashdata->arena.text + offset, slot.hash1,\
+                 slot.hash2, &counter)) {
+        return false;
+    }
+
+    if (hashdata->word_count >= hashdata->max_table_load) {
+        ResizeHashTable(hashdata);
+    }
+    InsertSlot(hashdata, &slot);
+    hashdata->word_count++;
+    return true;
+}
+
+/* Places a slot in the table, doubling the table until there is room */
+void InsertSlot(HashData *hashdata, HashSlot *slot)
+{
+    HashSlot homeless = *slot;
+
+    while (!PlaceSlot(hashdata, &homeless)) {
+        ResizeHashTable(hashdata);
+    }
+}
+
+/* Puts a slot in a free slot of either of its buckets. With both full, a
+ * random resident is kicked out to its other bucket, and so on for up to
+ * MAXKICKS kicks, before the stash takes whichever word is left over.
+ * Returns false, with that word in slot, only if the stash is full too */
+int PlaceSlot(HashData *hashdata, HashSlot *slot)
+{
+    HashBucket *bucket;
+    HashSlot evicted;
+    unsigned int curr_bucket = slot->hash1 & hashdata->bucket_mask;
+    int kick, victim;
+
+    if (BucketAdd(&hashdata->buckets[curr_bucket], slot)) {
+        return true;
+    }
+    curr_bucket = OtherBucket(hashdata, curr_bucket, slot);
+    if (BucketAdd(&hashdata->buckets[curr_bucket], slot)) {
+        return true;
+    }
+
+    for (kick = 0; kick < MAXKICKS; kick++) {
+        /* Swap the slot with a random resident of the full bucket */
+        bucket = &hashdata->buckets[curr_bucket];
+        victim = NextKick(hashdata) % BUCKETSLOTS;
+        evicted.word = bucket->word[victim];
+        evicted.hash1 = bucket->hash1[victim];
+        evicted.hash2 = bucket->hash2[victim];
+        bucket->word[victim] = slot->word;
+        bucket->hash1[victim] = slot->hash1;
+        bucket->hash2[victim] = slot->hash2;
+        *slot = evicted;
+
+        /* The resident moves on to its other bucket, done if that has room */
+        curr_bucket = OtherBucket(hashdata, curr_bucket, slot);
+        if (BucketAdd(&hashdata->buckets[curr_bucket], slot)) {
+            return true;
+        }
+    }
+
+    if (hashdata->stash_count < STASHSIZE) {
+        hashdata->stash[hashdata->stash_count] = *slot;
+        hashdata->stash_count++;
+        return true;
+    }
+    return false;
+}
+
+/* Puts a slot in the first empty slot of a bucket, false if it is full */
+int BucketAdd(HashBucket *bucket, HashSlot *slot)
+{
+    int i;
+
+    for (i = 0; i < BUCKETSLOTS; i++) {
+        if (bucket->word[i] == EMPTYSLOT) {
+            bucket->word[i] = slot->word;
+            bucket->hash1[i] = slot->hash1;
+            bucket->hash2[i] = slot->hash2;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* The bucket a slot's word can move to from the given one of its two. hash1
+ * picks the first & hash2 the second, which is forced to differ */
+unsigned int OtherBucket(HashData *hashdata, unsigned int bucket,
+                         HashSlot *slot)
+{
+    unsigned int bucket1 = slot->hash1 & hashdata->bucket_mask;
+    unsigned int bucket2 = slot->hash2 & hashdata->bucket_mask;
+
+    if (bucket2 == bucket1) {
+        bucket2 = bucket1 ^ 1;
+    }
+    return bucket == bucket1 ? bucket2 : bucket1;
+}
+
+/* Next value of a xorshift generator, only used to pick kick victims */
+unsigned int NextKick(HashData *hashdata)
+{
+    unsigned int state = hashdata->kick_state;
+
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    hashdata->kick_state = state;
+    return state;
+}
+
+/* Bit i set for each slot i of the bucket whose hash1 matches */
+unsigned int BucketMatch(HashBucket *bucket, unsigned int hash1)
+{
+#ifdef __SSE2__
+    __m128i hashes = _mm_loadu_si128((const __m128i *)bucket->hash1);
+
+    return (unsigned int)_mm_movemask_ps(_mm_castsi128_ps(\
+        _mm_cmpeq_epi32(hashes, _mm_set1_epi32((int)hash1))));
+#else
+    unsigned int mask = 0;
+    int i;
+
+    for (i = 0; i < BUCKETSLOTS; i++) {
+        if (bucket->hash1[i] == hash1) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+#endif
+}
+
+/* Calculates a hash using the start & end 2 chars and string length */
+unsigned int HashFunc1(char *str)
+{
+    unsigned int c1, c2, cn1, cn2;
+    unsigned int hash;
+    unsigned int n;
+
+    n = (unsigned int)strlen(str);
+    c1 = str[0];
+    c2 = str[1];
+    cn1 = str[n - 1];
+    /* A one letter word has no second last char, don't read before it */
+    cn2 = n > 1 ? str[n - 2] : 0;
+
+    hash = (c1*c2 + cn1*cn2) * n;
+
+    return hash;
+}
+
+/* Calculates a hash using each char & string length */
+unsigned int HashFunc2(char *str)
+{
+    int i;
+    int n = strlen(str);
+    unsigned int hash = 0;
+
+    for (i = 0; i < n; i++) {
+        hash = str[i] + PRIME * hash;
+    }
+
+    return hash;
+}
+
+/* The original pair of hashes as one family, HashFunc1 in the low half and
+ * HashFunc2 in the high half, put through murmur3's 64 bit finaliser. Many
+ * words share a HashFunc1 value, & mixing the pair keeps those words from
+ * all having the same first bucket. Unseeded */
+uint64_t HashClassic(char *str, uint64_t seed)
+{
+    uint64_t hash = ((uint64_t)HashFunc2(str) << 32) | HashFunc1(str);
+
+    (void)seed;
+    hash ^= hash >> 33;
+    hash *= UINT64_C(0xFF51AFD7ED558CCD);
+    hash ^= hash >> 33;
+    hash *= UINT64_C(0xC4CEB9FE1A85EC53);
+    hash ^= hash >> 33;
+    return hash;
+}
+
+/* Creates a new table with twice the buckets */
+void ResizeHashTable(HashData *hashdata)
+{
+    RehashTable(hashdata, (hashdata->bucket_mask + 1) * 2);
+}
+
+/* Creates a new table of num_buckets buckets & moves every word of the old
+ * one & its stash into it by their stored hashes. If kicking still fails
+ * to place them all, the new table is dropped and one twice as big tried */
+void RehashTable(HashData *hashdata, int num_buckets)
+{
+    HashBucket *old_buckets = hashdata->buckets;
+    HashSlot old_stash[STASHSIZE];
+    HashSlot slot;
+    int old_num_buckets = (int)hashdata->bucket_mask + 1;
+    int old_stash_count = hashdata->stash_count;
+    int i, j, placed;
+    double start = WallSeconds();
+
+    memcpy(old_stash, hashdata->stash, sizeof(old_stash));
+
+    do {
+        if (num_buckets > MAXBUCKETS) {
+            fprintf(stderr, ERR_TABLE_MAX);
+            exit(hash_table_full);
+        }
+        NewHashTable(hashdata, num_buckets);
+        placed = true;
+
+        for (i = 0; i < old_num_buckets && placed; i++) {
+            for (j = 0; j < BUCKETSLOTS && placed; j++) {
+                if (old_buckets[i].word[j] != EMPTYSLOT) {
+                    slot.word = old_buckets[i].word[j];
+                    slot.hash1 = old_buckets[i].hash1[j];
+                    slot.hash2 = old_buckets[i].hash2[j];
+                    placed = PlaceSlot(hashdata, &slot);
+                }
+            }
+        }
+        for (i = 0; i < old_stash_count && placed; i++) {
+            slot = old_stash[i];
+            placed = PlaceSlot(hashdata, &slot);
+        }
+
+        if (!placed) {
+            free(hashdata->buckets);
+            num_buckets *= 2;
+        }
+    }
+    while (!placed);
+    free(old_buckets);
+
+    hashdata->resize_count++;
+    hashdata->resize_seconds += WallSeconds() - start;
+}
+
+/* Grows the table once, straight to a size that holds capacity words
+ * without any further resizes. A table that is already big enough is kept */
+void ReserveCapacity(HashData *hashdata, long capacity)
+{
+    int num_buckets = CapacityBuckets(capacity);
+
+    if (num_buckets <= (int)hashdata->bucket_mask + 1) {
+        return;
+    }
+
+    /* An empty table has nothing to move, so is simply replaced */
+    if (hashdata->word_count == 0) {
+        free(hashdata->buckets);
+        NewHashTable(hashdata, num_buckets);
+    }
+    else {
+        RehashTable(hashdata, num_buckets);
+    }
+}
+
+/* The fewest buckets whose maximum load is above capacity, since a table is
+ * grown on reaching its maximum load */
+int CapacityBuckets(long capacity)
+{
+    long num_buckets = MINBUCKETS;
+
+    while ((long)(num_buckets * BUCKETSLOTS * MAXLOADFRACTION) <= capacity) {
+        num_buckets *= 2;
+        if (num_buckets > MAXBUCKETS) {
+            fprintf(stderr, ERR_TABLE_MAX);
+            exit(hash_table_full);
+        }
+    }
+    return (int)num_buckets;
+}
+
+/* The fewest buckets, a power of two, holding at least size slots */
+int BucketCount(long size)
+{
+    long num_buckets = MINBUCKETS;
+
+    while (num_buckets * BUCKETSLOTS < size) {
+        num_buckets *= 2;
+        if (num_buckets > MAXBUCKETS) {
+            fprintf(stderr, ERR_TABLE_MAX);
+            exit(hash_table_full);
+        }
+    }
+    return (int)num_buckets;
+}
+
+/* Frees the buckets, then every word at once with the arena */
+void FreeHashTable(HashData *hashdata)
+{
+    free(hashdata->buckets);
+
+    if (hashdata->arena.mapped) {
+        munmap(hashdata->arena.text, hashdata->arena.used);
+    }
+    else {
+        free(hashdata->arena.text);
+    }
+}
+
+/* p5 adds nothing to the driver's own report */
+void ReportTable(HashData *hashdata)
+{
+    (void)hashdata;
+}
+
+/* Nor to the benchmark's JSON */
+void ReportTableJson(HashData *hashdata)
+{
+    (void)hashdata;
+}
+
+/* Returns the buckets probed to find the word, or NOTFOUND. The table is
+ * only read, so several threads may search it at once */
+int FindWord(HashData *hashdata, char *curr_word)
+{
+    uint64_t full_hash;
+    int counter = 0;
+
+    full_hash = hashdata->hash_family->hash(curr_word, hashdata->hash_seed);
+    if (!FindSlot(hashdata, curr_word, (unsigned int)full_hash,\
+                  (unsigned int)(full_hash >> 32), &counter)) {
+        return NOTFOUND;
+    }
+    return counter;
+}
+
+/* Looks in the word's two buckets, then the stash if it is in use, adding
+ * each one looked in to counter. Never more than three, however full the
+ * table is. Returns whether the word was found */
+int FindSlot(HashData *hashdata, char *curr_word, unsigned int hash1,
+             unsigned int hash2, int *counter)
+{
+    HashBucket *bucket;
+    HashSlot probe;
+    unsigned int mask, curr_bucket = hash1 & hashdata->bucket_mask;
+    int i, tries;
+
+    probe.hash1 = hash1;
+    probe.hash2 = hash2;
+    for (tries = 0; tries < 2; tries++) {
+        (*counter)++;
+        bucket = &hashdata->buckets[curr_bucket];
+
+        /* Only slots whose hashes both match have their word compared */
+        mask = BucketMatch(bucket, hash1);
+        for (i = 0; mask != 0; i++, mask >>= 1) {
+            if ((mask & 1u) && bucket->hash2[i] == hash2 &&
+                bucket->word[i] != EMPTYSLOT &&
+                strcmp(hashdata->arena.text + bucket->word[i],\
+                       curr_word) == 0) {
+                return true;
+            }
+        }
+        curr_bucket = OtherBucket(hashdata, curr_bucket, &probe);
+    }
+
+    if (hashdata->stash_count > 0) {
+        (*counter)++;
+        for (i = 0; i < hashdata->stash_count; i++) {
+            if (hashdata->stash[i].hash1 == hash1 &&
+                hashdata->stash[i].hash2 == hash2 &&
+                strcmp(hashdata->arena.text + hashdata->stash[i].word,\
+                       curr_word) == 0) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+/* Returns the total buckets probed to find the batch, or NOTFOUND if any of
+ * its words is missing. All the hashes are computed and both buckets
+ * prefetched up front, so the words' cache misses overlap before each is
+ * probed in turn. Only reads the table */
+int FindWordBatch(HashData *hashdata, char **words, int num_words)
+{
+    uint64_t full_hashes[BATCHSIZE];
+    HashSlot probe;
+    int i, total_lookups = 0;
+
+    /* Hash the whole batch together, which may use the vector path */
+    hashdata->hash_family->hash_batch(hashdata->hash_family, words,\
+                                      num_words, hashdata->hash_seed,\
+                                      full_hashes);
+
+    /* Both buckets of every word start loading before any is compared */
+    for (i = 0; i < num_words; i++) {
+        probe.hash1 = (unsigned int)full_hashes[i];
+        probe.hash2 = (unsigned int)(full_hashes[i] >> 32);
+        PREFETCH(&hashdata->buckets[probe.hash1 & hashdata->bucket_mask]);
+        PREFETCH(&hashdata->buckets[OtherBucket(hashdata,\
+            probe.hash1 & hashdata->bucket_mask, &probe)]);
+    }
+
+    for (i = 0; i < num_words; i++) {
+        if (!FindSlot(hashdata, words[i], (unsigned int)full_hashes[i],\
+                      (unsigned int)(full_hashes[i] >> 32), &total_lookups)) {
+            return NOTFOUND;
+        }
+    }
+
+    return total_lookups;
+}
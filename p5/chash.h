@@ -0,0 +1,81 @@
+#include "spll.h"
+
+#define MAXLOADFRACTION 0.95
+#define EMPTYSLOT 0xFFFFFFFFu
+#define BUCKETSLOTS 4
+#define BUCKETALIGN 64
+#define MINBUCKETS 2
+#define MAXBUCKETS (1 << 27)
+#define MAXKICKS 500
+#define STASHSIZE 8
+#define KICKSEED 0x2545F491u
+#define ENGINENAME "p5"
+
+/* Error Print Statements */
+#define ERR_TABLE_FULL   "ERROR - Hash table has not been resized correctly.\n"
+#define ERR_TABLE_MAX    "ERROR - Hash table cannot grow past MAXBUCKETS.\n"
+
+/* One word's arena offset & its pair of 32 bit hashes, which pick its two
+ * candidate buckets. Kicking a word to its other bucket or resizing never
+ * needs the word hashed again */
+typedef struct HashTableSlot {
+    unsigned int word;
+    unsigned int hash1;
+    unsigned int hash2;
+} HashSlot;
+
+/* BUCKETSLOTS slots stored as arrays, so a bucket's hash1 values can be
+ * compared at once. Padded to BUCKETALIGN bytes, a bucket is one cache line
+ * and a lookup touches at most two */
+typedef struct HashTableBucket {
+    unsigned int hash1[BUCKETSLOTS];
+    unsigned int hash2[BUCKETSLOTS];
+    unsigned int word[BUCKETSLOTS];
+    unsigned int pad[BUCKETALIGN / sizeof(unsigned int) - 3 * BUCKETSLOTS];
+} HashBucket;
+
+/* Bucketized cuckoo hashing, every word is in one of its two buckets or in
+ * the small stash of words no kick sequence could place */
+struct HashTableData {
+    HashBucket *buckets;
+    unsigned int bucket_mask;
+    int table_size;
+    int max_table_load;
+    int word_count;
+    HashSlot stash[STASHSIZE];
+    int stash_count;
+    /* State of the xorshift generator picking which slot to kick */
+    unsigned int kick_state;
+    StrArena arena;
+    /* Hash function chosen at startup, and its seed */
+    const HashFamily *hash_family;
+    uint64_t hash_seed;
+    /* Resizes so far & the wall clock time spent in them */
+    int resize_count;
+    double resize_seconds;
+    /* Count the dictionary's lines first & size the table for them once */
+    int presize;
+    /* Look words up BATCHSIZE at a time in HashSearchTest */
+    int batch_lookups;
+    /* Split HashSearchTest over this many threads when more than 1 */
+    int num_threads;
+    /* Count hardware events around the benchmark's build & search */
+    int perf_counters;
+};
+
+void NewHashTable(HashData *hashdata, int num_buckets);
+void InsertSlot(HashData *hashdata, HashSlot *slot);
+int PlaceSlot(HashData *hashdata, HashSlot *slot);
+int BucketAdd(HashBucket *bucket, HashSlot *slot);
+unsigned int OtherBucket(HashData *hashdata, unsigned int bucket,
+                         HashSlot *slot);
+unsigned int NextKick(HashData *hashdata);
+unsigned int BucketMatch(HashBucket *bucket, unsigned int hash1);
+unsigned int HashFunc1(char *str);
+unsigned int HashFunc2(char *str);
+void ResizeHashTable(HashData *hashdata);
+void RehashTable(HashData *hashdata, int num_buckets);
+int CapacityBuckets(long capacity);
+int BucketCount(long size);
+int FindSlot(HashData *hashdata, char *curr_word, unsigned int hash1,
+             unsigned int hash2, int *counter);
@@ -0,0 +1,2 @@
+/* The table the shared sources in common are built against */
+#include "mphash.h"
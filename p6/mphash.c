@@ -0,0 +1,532 @@
+#include "mphash.h"
+
+#define PRIME 31
+
+void InitHashData(HashData *hashdata, int size)
+{
+    /* Start with an empty string arena, words are bump allocated into it */
+    hashdata->arena.text = malloc(ARENASTARTSIZE);
+    if (hashdata->arena.text == NULL) {
+        fprintf(stderr, ERR_NO_MEMORY);
+        exit(out_of_memory);
+    }
+    hashdata->arena.used = 0;
+    hashdata->arena.size = ARENASTARTSIZE;
+    hashdata->arena.mapped = false;
+    hashdata->slots = NULL;
+    hashdata->slots_size = 0;
+    hashdata->pilots = NULL;
+    hashdata->remap = NULL;
+    hashdata->word_count = 0;
+    hashdata->table_size = 0;
+    hashdata->num_buckets = 0;
+    hashdata->dense_buckets = 0;
+    hashdata->build_seed = 0;
+    hashdata->hash_family = &HashFamilies[0];
+    hashdata->hash_seed = DEFAULTSEED;
+    hashdata->resize_count = 0;
+    hashdata->resize_seconds = 0;
+    hashdata->presize = false;
+    hashdata->batch_lookups = false;
+    hashdata->num_threads = 1;
+    hashdata->perf_counters = false;
+
+    ReserveCapacity(hashdata, size > 0 ? size : 1);
+}
+
+/* Gathers every word of the dictionary, then builds the perfect hash over
+ * them all at once. Words from earlier calls are included in the build */
+void CreateHashTable(HashData *hashdata, char *filename)
+{
+    ReadDictionary(hashdata, filename);
+    BuildPerfectHash(hashdata);
+}
+
+/* Adds a word that is already in the arena to the word list, doubling the
+ * list when full. The perfect hash no longer covers every word, so lookups
+ * fail until it is rebuilt. Duplicates are dropped by the build, so it
+ * always returns true */
+int AddArenaWord(HashData *hashdata, unsigned int offset)
+{
+    if (hashdata->word_count == hashdata->slots_size) {
+        ReserveCapacity(hashdata, (long)hashdata->slots_size * 2);
+    }
+    hashdata->slots[hashdata->word_count] = offset;
+    hashdata->word_count++;
+    hashdata->table_size = 0;
+    return true;
+}
+
+/* Calculates a hash using the start & end 2 chars and string length */
+unsigned int HashFunc1(char *str)
+{
+    unsigned int c1, c2, cn1, cn2;
+    unsigned int hash;
+    unsigned int n;
+
+    n = (unsigned int)strlen(str);
+    c1 = str[0];
+    c2 = str[1];
+    cn1 = str[n - 1];
+    /* A one letter word has no second last char, don't read before it */
+    cn2 = n > 1 ? str[n - 2] : 0;
+
+    hash = (c1*c2 + cn1*cn2) * n;
+
+    return hash;
+}
+
+/* Calculates a hash using each char & string length */
+unsigned int HashFunc2(char *str)
+{
+    int i;
+    int n = strlen(str);
+    unsigned int hash = 0;
+
+    for (i = 0; i < n; i++) {
+        hash = str[i] + PRIME * hash;
+    }
+
+    return hash;
+}
+
+/* The original pair of hashes as one family, HashFunc1 in the low half and
+ * HashFunc2 in the high half, put through Mix64 so every bit of the pair
+ * reaches the bucket & position. Unseeded */
+uint64_t HashClassic(char *str, uint64_t seed)
+{
+    (void)seed;
+    return Mix64(((uint64_t)HashFunc2(str) << 32) | HashFunc1(str));
+}
+
+/* murmur3's 64 bit finaliser, every bit of the input affects every bit of
+ * the output */
+uint64_t Mix64(uint64_t hash)
+{
+    hash ^= hash >> 33;
+    hash *= UINT64_C(0xFF51AFD7ED558CCD);
+    hash ^= hash >> 33;
+    hash *= UINT64_C(0xC4CEB9FE1A85EC53);
+    hash ^= hash >> 33;
+    return hash;
+}
+
+/* The hash a word is placed by, its family's hash mixed with the build's
+ * seed, so a failed build can be retried with fresh hashes */
+uint64_t BuildHash(HashData *hashdata, char *str)
+{
+    return Mix64(hashdata->hash_family->hash(str, hashdata->hash_seed) ^\
+                 hashdata->build_seed);
+}
+
+/* Maps a 32 bit hash evenly onto 0 .. range - 1 with a multiply instead of
+ * a divide */
+unsigned int FastRange(unsigned int hash, unsigned int range)
+{
+    return (unsigned int)(((uint64_t)hash * range) >> 32);
+}
+
+/* The bucket of a word's hash. DENSEKEYFRACTION of the words share the
+ * first DENSEBUCKETFRACTION of the buckets, so the big buckets placed first
+ * hold most words & the many small ones left over fill the last gaps */
+unsigned int KeyBucket(HashData *hashdata, uint64_t hash)
+{
+    if ((unsigned int)(hash >> 32) < DENSETHRESHOLD) {
+        return FastRange((unsigned int)hash,\
+                         (unsigned int)hashdata->dense_buckets);
+    }
+    return hashdata->dense_buckets + FastRange((unsigned int)hash,\
+        (unsigned int)(hashdata->num_buckets - hashdata->dense_buckets));
+}
+
+/* The position a pilot sends a word to, 0 .. table_size - 1 */
+unsigned int PilotPosition(HashData *hashdata, uint64_t hash,
+                           unsigned int pilot)
+{
+    return FastRange((unsigned int)(Mix64(hash ^ (pilot * PILOTMIX)) >> 32),\
+                     (unsigned int)hashdata->table_size);
+}
+
+/* The slot of a word, the position its bucket's pilot sends it to or, for
+ * positions from word_count up, the gap that position was remapped to */
+unsigned int WordPosition(HashData *hashdata, uint64_t hash)
+{
+    unsigned int pos = PilotPosition(hashdata, hash,\
+        hashdata->pilots[KeyBucket(hashdata, hash)]);
+
+    if (pos >= (unsigned int)hashdata->word_count) {
+        pos = hashdata->remap[pos - hashdata->word_count];
+    }
+    return pos;
+}
+
+/* Builds the perfect hash over the word list, dropping repeated words. A
+ * build that finds no pilot for some bucket is retried with a new seed */
+void BuildPerfectHash(HashData *hashdata)
+{
+    BuildKey *keys;
+    int i, num_keys, tries;
+    double start = WallSeconds();
+
+    free(hashdata->pilots);
+    free(hashdata->remap);
+    hashdata->pilots = NULL;
+    hashdata->remap = NULL;
+    hashdata->table_size = 0;
+    hashdata->num_buckets = 0;
+    hashdata->dense_buckets = 0;
+    if (hashdata->word_count == 0) {
+        return;
+    }
+
+    keys = (BuildKey *)malloc(hashdata->word_count * sizeof(BuildKey));
+    if (keys == NULL) {
+        fprintf(stderr, ERR_NO_MEMORY);
+        exit(out_of_memory);
+    }
+    for (i = 0; i < hashdata->word_count; i++) {
+        keys[i].word = hashdata->slots[i];
+        keys[i].hash = BuildHash(hashdata,\
+                                 hashdata->arena.text + hashdata->slots[i]);
+    }
+    /* Sorted by hash, copies of a word lie next to each other */
+    qsort(keys, hashdata->word_count, sizeof(BuildKey), CompareBuildKeys);
+    num_keys = DropDuplicates(hashdata, keys, hashdata->word_count);
+
+    for (tries = 1; !TryBuild(hashdata, keys, num_keys); tries++) {
+        if (tries == MAXBUILDTRIES) {
+            fprintf(stderr, ERR_NO_PILOTS);
+            exit(hash_table_full);
+        }
+        hashdata->build_seed = Mix64(hashdata->build_seed + PILOTMIX);
+        for (i = 0; i < num_keys; i++) {
+            keys[i].hash = BuildHash(hashdata,\
+                                     hashdata->arena.text + keys[i].word);
+        }
+    }
+    free(keys);
+
+    hashdata->resize_seconds += WallSeconds() - start;
+}
+
+/* One try at the perfect hash with the current seed. Sizes the table &
+ * buckets for num_keys words, finds each bucket a pilot, biggest buckets
+ * first, then remaps the positions past the last word into the gaps left
+ * below it. Returns false, leaving the word list alone, if a bucket has
+ * no pilot */
+int TryBuild(HashData *hashdata, BuildKey *keys, int num_keys)
+{
+    BuildKey *bucket_keys;
+    unsigned int *bucket_starts, *size_starts, *order, *positions;
+    unsigned int *slots, *remap;
+    unsigned short *pilots;
+    unsigned char *taken;
+    unsigned int pos, free_pos;
+    int i, b, size, pilot, log_keys, max_size = 0, found = true;
+
+    hashdata->resize_count++;
+
+    /* Buckets average about log2(num_keys) / MPHBUCKETFACTOR words */
+    log_keys = 1;
+    while ((1L << log_keys) < num_keys) {
+        log_keys++;
+    }
+    hashdata->table_size = (int)(num_keys / MPHALPHA);
+    hashdata->num_buckets =\
+        (int)(MPHBUCKETFACTOR * num_keys / log_keys) + 2;
+    hashdata->dense_buckets =\
+        (int)(hashdata->num_buckets * DENSEBUCKETFRACTION) + 1;
+
+    bucket_keys = (BuildKey *)malloc(num_keys * sizeof(BuildKey));
+    bucket_starts = (unsigned int *)calloc(hashdata->num_buckets + 2,\
+                                           sizeof(unsigned int));
+    order = (unsigned int *)malloc(hashdata->num_buckets *\
+                                   sizeof(unsigned int));
+    pilots = (unsigned short *)calloc(hashdata->num_buckets,\
+                                      sizeof(unsigned short));
+    taken = (unsigned char *)calloc((hashdata->table_size + 7) / 8, 1);
+    if (bucket_keys == NULL || bucket_starts == NULL || order == NULL ||
+        pilots == NULL || taken == NULL) {
+        fprintf(stderr, ERR_NO_MEMORY);
+        exit(out_of_memory);
+    }
+
+    /* Counting sort the words by bucket, bucket b is then bucket_keys from
+     * bucket_starts[b] up to bucket_starts[b + 1] */
+    for (i = 0; i < num_keys; i++) {
+        keys[i].bucket = KeyBucket(hashdata, keys[i].hash);
+        bucket_starts[keys[i].bucket + 2]++;
+    }
+    for (b = 0; b < hashdata->num_buckets; b++) {
+        size = bucket_starts[b + 2];
+        if (size > max_size) {
+            max_size = size;
+        }
+        bucket_starts[b + 2] += bucket_starts[b + 1];
+    }
+    for (i = 0; i < num_keys; i++) {
+        bucket_keys[bucket_starts[keys[i].bucket + 1]++] = keys[i];
+    }
+
+    /* And the buckets by size, biggest first, while the table is emptiest */
+    size_starts = (unsigned int *)calloc(max_size + 3, sizeof(unsigned int));
+    positions = (unsigned int *)malloc(max_size * sizeof(unsigned int));
+    if (size_starts == NULL || positions == NULL) {
+        fprintf(stderr, ERR_NO_MEMORY);
+        exit(out_of_memory);
+    }
+    for (b = 0; b < hashdata->num_buckets; b++) {
+        size_starts[max_size - (bucket_starts[b + 1] - bucket_starts[b]) +\
+                    2]++;
+    }
+    for (size = 0; size <= max_size; size++) {
+        size_starts[size + 2] += size_starts[size + 1];
+    }
+    for (b = 0; b < hashdata->num_buckets; b++) {
+        order[size_starts[max_size -\
+            (bucket_starts[b + 1] - bucket_starts[b]) + 1]++] = b;
+    }
+
+    /* Empty buckets come last & keep pilot 0 */
+    for (i = 0; i < hashdata->num_buckets && found; i++) {
+        b = order[i];
+        size = bucket_starts[b + 1] - bucket_starts[b];
+        if (size == 0) {
+            break;
+        }
+        pilot = FindPilot(hashdata, bucket_keys + bucket_starts[b], size,\
+                          taken, positions);
+        if (pilot == NOTFOUND) {
+            found = false;
+        }
+        else {
+            pilots[b] = (unsigned short)pilot;
+        }
+    }
+    free(bucket_keys);
+    free(bucket_starts);
+    free(size_starts);
+    free(order);
+    free(positions);
+
+    if (!found) {
+        free(pilots);
+        free(taken);
+        hashdata->table_size = 0;
+        return false;
+    }
+
+    /* Each position taken past the last word moves to the next gap below
+     * it, there being exactly as many gaps as such positions */
+    remap = (unsigned int *)calloc(hashdata->table_size - num_keys + 1,\
+                                   sizeof(unsigned int));
+    slots = (unsigned int *)malloc(num_keys * sizeof(unsigned int));
+    if (remap == NULL || slots == NULL) {
+        fprintf(stderr, ERR_NO_MEMORY);
+        exit(out_of_memory);
+    }
+    free_pos = 0;
+    for (pos = num_keys; pos < (unsigned int)hashdata->table_size; pos++) {
+        if (taken[pos >> 3] & (1u << (pos & 7))) {
+            while (taken[free_pos >> 3] & (1u << (free_pos & 7))) {
+                free_pos++;
+            }
+            remap[pos - num_keys] = free_pos;
+            free_pos++;
+        }
+    }
+    free(taken);
+
+    free(hashdata->slots);
+    hashdata->slots = slots;
+    hashdata->slots_size = num_keys;
+    hashdata->word_count = num_keys;
+    hashdata->pilots = pilots;
+    hashdata->remap = remap;
+    for (i = 0; i < num_keys; i++) {
+        hashdata->slots[WordPosition(hashdata, keys[i].hash)] = keys[i].word;
+    }
+
+    return true;
+}
+
+/* Tries pilots from 0 up until one sends every word of a bucket to a free
+ * position & no two to the same one. Takes those positions & returns the
+ * pilot, or NOTFOUND if none up to MAXPILOT does */
+int FindPilot(HashData *hashdata, BuildKey *bucket_keys, int bucket_size,
+              unsigned char *taken, unsigned int *positions)
+{
+    unsigned int pilot, pos;
+    int i, j, placed;
+
+    for (pilot = 0; pilot <= MAXPILOT; pilot++) {
+        placed = true;
+        for (i = 0; i < bucket_size && placed; i++) {
+            pos = PilotPosition(hashdata, bucket_keys[i].hash, pilot);
+            placed = !(taken[pos >> 3] & (1u << (pos & 7)));
+            positions[i] = pos;
+            for (j = 0; j < i && placed; j++) {
+                placed = positions[j] != positions[i];
+            }
+        }
+        if (placed) {
+            for (i = 0; i < bucket_size; i++) {
+                taken[positions[i] >> 3] |= 1u << (positions[i] & 7);
+            }
+            return (int)pilot;
+        }
+    }
+    return NOTFOUND;
+}
+
+/* Drops repeated words from keys sorted by hash, returning how many are
+ * left. Exits if two different words share a whole 64 bit hash, as no
+ * pilot could ever send them to different positions */
+int DropDuplicates(HashData *hashdata, BuildKey *keys, int num_keys)
+{
+    int i, kept = 0;
+
+    for (i = 0; i < num_keys; i++) {
+        if (kept > 0 && keys[i].hash == keys[kept - 1].hash) {
+            if (strcmp(hashdata->arena.text + keys[i].word,\
+                       hashdata->arena.text + keys[kept - 1].word) != 0) {
+                fprintf(stderr, ERR_HASH_CLASH);
+                exit(hash_table_full);
+            }
+            continue;
+        }
+        keys[kept] = keys[i];
+        kept++;
+    }
+    return kept;
+}
+
+/* qsort comparison for build keys in ascending hash order */
+int CompareBuildKeys(const void *a, const void *b)
+{
+    uint64_t x = ((const BuildKey *)a)->hash, y = ((const BuildKey *)b)->hash;
+
+    return (x > y) - (x < y);
+}
+
+/* Bits of pilots & remap entries the perfect hash keeps per word, on top
+ * of the word's own slot */
+double MetadataBits(HashData *hashdata)
+{
+    size_t pilot_bytes = hashdata->num_buckets * sizeof(unsigned short);
+    size_t remap_bytes =\
+        (hashdata->table_size - hashdata->word_count) * sizeof(unsigned int);
+
+    if (hashdata->table_size == 0) {
+        return 0;
+    }
+    return 8.0 * (pilot_bytes + remap_bytes) / hashdata->word_count;
+}
+
+/* Grows the word list once, straight to room for capacity words. A list
+ * that is already big enough is kept */
+void ReserveCapacity(HashData *hashdata, long capacity)
+{
+    unsigned int *slots;
+
+    if (capacity <= hashdata->slots_size) {
+        return;
+    }
+    if (capacity > MAXWORDS) {
+        fprintf(stderr, ERR_TABLE_MAX);
+        exit(hash_table_full);
+    }
+    slots = (unsigned int *)realloc(hashdata->slots,\
+                                    capacity * sizeof(unsigned int));
+    if (slots == NULL) {
+        fprintf(stderr, ERR_NO_MEMORY);
+        exit(out_of_memory);
+    }
+    hashdata->slots = slots;
+    hashdata->slots_size = (int)capacity;
+}
+
+/* Frees the slots & perfect hash, then every word at once with the arena */
+void FreeHashTable(HashData *hashdata)
+{
+    free(hashdata->slots);
+    free(hashdata->pilots);
+    free(hashdata->remap);
+
+    if (hashdata->arena.mapped) {
+        munmap(hashdata->arena.text, hashdata->arena.used);
+    }
+    else {
+        free(hashdata->arena.text);
+    }
+}
+
+/* The perfect hash's size & build, after the driver's own report */
+void ReportTable(HashData *hashdata)
+{
+    printf("Perfect hash of %d words, %f bits of metadata per word, built "
+           "in %f seconds over %d tries.\n", hashdata->word_count,
+           MetadataBits(hashdata), hashdata->resize_seconds,
+           hashdata->resize_count);
+}
+
+/* The perfect hash's metadata per word, for the benchmark's JSON */
+void ReportTableJson(HashData *hashdata)
+{
+    printf(", \"bits_per_key\": %f", MetadataBits(hashdata));
+}
+
+/* Returns 1, the one slot looked in, or NOTFOUND. The table is only read,
+ * so several threads may search it at once */
+int FindWord(HashData *hashdata, char *curr_word)
+{
+    unsigned int pos;
+
+    if (hashdata->table_size == 0) {
+        return NOTFOUND;
+    }
+    pos = WordPosition(hashdata, BuildHash(hashdata, curr_word));
+    if (strcmp(hashdata->arena.text + hashdata->slots[pos], curr_word) != 0) {
+        return NOTFOUND;
+    }
+    return 1;
+}
+
+/* Returns the total slots looked in for the batch, one a word, or NOTFOUND
+ * if any of its words is missing. All the hashes are computed first, then
+ * each step's loads are prefetched for the whole batch before any is
+ * needed, so the words' cache misses overlap. Only reads the table */
+int FindWordBatch(HashData *hashdata, char **words, int num_words)
+{
+    uint64_t hashes[BATCHSIZE];
+    unsigned int positions[BATCHSIZE];
+    int i;
+
+    if (hashdata->table_size == 0) {
+        return num_words == 0 ? 0 : NOTFOUND;
+    }
+
+    /* Hash the whole batch together, which may use the vector path */
+    hashdata->hash_family->hash_batch(hashdata->hash_family, words,\
+                                      num_words, hashdata->hash_seed, hashes);
+    for (i = 0; i < num_words; i++) {
+        hashes[i] = Mix64(hashes[i] ^ hashdata->build_seed);
+        PREFETCH(&hashdata->pilots[KeyBucket(hashdata, hashes[i])]);
+    }
+    for (i = 0; i < num_words; i++) {
+        positions[i] = WordPosition(hashdata, hashes[i]);
+        PREFETCH(&hashdata->slots[positions[i]]);
+    }
+    for (i = 0; i < num_words; i++) {
+        PREFETCH(hashdata->arena.text + hashdata->slots[positions[i]]);
+    }
+
+    for (i = 0; i < num_words; i++) {
+        if (strcmp(hashdata->arena.text + hashdata->slots[positions[i]],\
+                   words[i]) != 0) {
+            return NOTFOUND;
+        }
+    }
+
+    return num_words;
+}
@@ -0,0 +1,74 @@
+#include "spll.h"
+
+#define MAXWORDS (1 << 30)
+#define MPHALPHA 0.99
+#define MPHBUCKETFACTOR 3.5
+#define DENSEKEYFRACTION 0.6
+#define DENSEBUCKETFRACTION 0.3
+#define DENSETHRESHOLD ((unsigned int)(DENSEKEYFRACTION * 4294967296.0))
+#define PILOTMIX UINT64_C(0x9E3779B97F4A7C15)
+#define MAXPILOT 0xFFFF
+#define MAXBUILDTRIES 32
+#define ENGINENAME "p6"
+
+/* Error Print Statements */
+#define ERR_TABLE_MAX    "ERROR - Hash table cannot grow past MAXWORDS.\n"
+#define ERR_HASH_CLASH   "ERROR - Two words share a hash, try another -hash.\n"
+#define ERR_NO_PILOTS    "ERROR - No perfect hash found for the dictionary.\n"
+
+/* One dictionary word during the build, its build hash & bucket */
+typedef struct BuildKeyEntry {
+    uint64_t hash;
+    unsigned int word;
+    unsigned int bucket;
+} BuildKey;
+
+/* A PTHash style minimal perfect hash over a static set of words. Each
+ * word's hash picks a bucket, the bucket's pilot sends the word to its own
+ * position below table_size, & positions from word_count up are remapped
+ * into the gaps below it. slots holds each position's word, so a lookup is
+ * one position & one word compare. Until built, slots lists the words */
+struct HashTableData {
+    unsigned int *slots;
+    unsigned short *pilots;
+    unsigned int *remap;
+    int word_count;
+    int slots_size;
+    int table_size;
+    int num_buckets;
+    int dense_buckets;
+    /* Seed mixed into every word's hash, changed if a build fails */
+    uint64_t build_seed;
+    StrArena arena;
+    /* Hash function chosen at startup, and its seed */
+    const HashFamily *hash_family;
+    uint64_t hash_seed;
+    /* Perfect hash builds so far, including failed tries, & their time */
+    int resize_count;
+    double resize_seconds;
+    /* Count the dictionary's lines first & size the table for them once */
+    int presize;
+    /* Look words up BATCHSIZE at a time in HashSearchTest */
+    int batch_lookups;
+    /* Split HashSearchTest over this many threads when more than 1 */
+    int num_threads;
+    /* Count hardware events around the benchmark's build & search */
+    int perf_counters;
+};
+
+unsigned int HashFunc1(char *str);
+unsigned int HashFunc2(char *str);
+uint64_t Mix64(uint64_t hash);
+uint64_t BuildHash(HashData *hashdata, char *str);
+unsigned int FastRange(unsigned int hash, unsigned int range);
+unsigned int KeyBucket(HashData *hashdata, uint64_t hash);
+unsigned int PilotPosition(HashData *hashdata, uint64_t hash,
+                           unsigned int pilot);
+unsigned int WordPosition(HashData *hashdata, uint64_t hash);
+void BuildPerfectHash(HashData *hashdata);
+int TryBuild(HashData *hashdata, BuildKey *keys, int num_keys);
+int DropDuplicates(HashData *hashdata, BuildKey *keys, int num_keys);
+int CompareBuildKeys(const void *a, const void *b);
+int FindPilot(HashData *hashdata, BuildKey *bucket_keys, int bucket_size,
+              unsigned char *taken, unsigned int *positions);
+double MetadataBits(HashData *hashdata);